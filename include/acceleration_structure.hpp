@@ -1,14 +1,17 @@
 #pragma once
 #include <memory>
 #include <vulkan/vulkan.hpp>
-
-struct Buffer;
+#include "acceleration_structure_arena.hpp"
 
 struct AccelerationStructure
 {
 protected:
     vk::AccelerationStructureKHR _vkStructure;
-    std::unique_ptr<Buffer> _structureBuffer;
-    std::unique_ptr<Buffer> _scratchBuffer; // TODO: Doesn't need to be stored after creation
-    std::unique_ptr<Buffer> _instancesBuffer;
+};
+
+// A structure that was replaced, but has to stay alive until the commands referencing it have executed
+struct RetiredAccelerationStructure
+{
+    vk::AccelerationStructureKHR structure;
+    AccelerationStructureAllocation storage;
 };
@@ -0,0 +1,66 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vk_mem_alloc.h>
+#include "common.hpp"
+
+class VulkanContext;
+class AccelerationStructureArena;
+struct Buffer;
+
+// Range of an arena block holding one acceleration structure, returned to the arena on destruction.
+// The arena has to outlive its allocations.
+struct AccelerationStructureAllocation
+{
+    AccelerationStructureAllocation() = default;
+    ~AccelerationStructureAllocation();
+    NON_COPYABLE(AccelerationStructureAllocation);
+    AccelerationStructureAllocation(AccelerationStructureAllocation&& other) noexcept;
+    AccelerationStructureAllocation& operator=(AccelerationStructureAllocation&& other) noexcept;
+
+    vk::Buffer buffer {};
+    vk::DeviceSize offset {};
+    vk::DeviceSize size {};
+
+private:
+    friend class AccelerationStructureArena;
+
+    AccelerationStructureArena* _arena = nullptr;
+    uint32_t _blockIndex {};
+    VmaVirtualAllocation _allocation {};
+};
+
+// Places acceleration structures at aligned offsets in a few large buffers, instead of a buffer and allocation per structure.
+// Space is suballocated with VMA virtual blocks, so structures replaced by compaction free their range for the next ones.
+class AccelerationStructureArena
+{
+public:
+    // Host visible arenas are needed for structures that are built on the host
+    AccelerationStructureArena(bool hostVisible, const std::shared_ptr<VulkanContext>& vulkanContext);
+    ~AccelerationStructureArena();
+    NON_COPYABLE(AccelerationStructureArena);
+    NON_MOVABLE(AccelerationStructureArena);
+
+    [[nodiscard]] AccelerationStructureAllocation Allocate(vk::DeviceSize size);
+
+private:
+    struct Block
+    {
+        std::unique_ptr<Buffer> buffer;
+        VmaVirtualBlock virtualBlock {};
+    };
+
+    void Free(AccelerationStructureAllocation& allocation);
+    void CreateBlock(Block& block, vk::DeviceSize size);
+
+    // Structures larger than this get a block of their own
+    static constexpr vk::DeviceSize BLOCK_SIZE = 128 * 1024 * 1024;
+    // Required alignment of the offset of acceleration structures in their buffer
+    static constexpr vk::DeviceSize STRUCTURE_ALIGNMENT = 256;
+
+    // Blocks are released once empty, their slot is reused by the next block
+    std::vector<Block> _blocks {};
+    bool _hostVisible = false;
+    std::shared_ptr<VulkanContext> _vulkanContext;
+};
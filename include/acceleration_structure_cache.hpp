@@ -0,0 +1,42 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "common.hpp"
+
+class VulkanContext;
+class BottomLevelAccelerationStructure;
+
+// Serialized bottom level acceleration structures on disk, one file per structure named after the key of its build input.
+// Serialized data starts with the UUIDs of the driver that wrote it, so entries written by another driver or device
+// are rejected and the structure is built and stored again.
+class AccelerationStructureCache
+{
+public:
+    AccelerationStructureCache(const std::filesystem::path& directory, const std::shared_ptr<VulkanContext>& vulkanContext);
+    ~AccelerationStructureCache() = default;
+    NON_COPYABLE(AccelerationStructureCache);
+    NON_MOVABLE(AccelerationStructureCache);
+
+    // Replaces every structure that has a compatible entry with its deserialized copy, returns which ones were restored.
+    // All structures need the same build type, which decides whether the copies run on the host or the device
+    [[nodiscard]] std::vector<bool> Restore(const std::vector<BottomLevelAccelerationStructure*>& structures, const std::vector<uint64_t>& keys);
+    // Serializes built structures and writes them to disk
+    void Store(const std::vector<BottomLevelAccelerationStructure*>& structures, const std::vector<uint64_t>& keys);
+
+private:
+    [[nodiscard]] std::filesystem::path EntryPath(uint64_t key) const;
+    [[nodiscard]] std::optional<std::vector<std::byte>> ReadEntry(uint64_t key) const;
+    void WriteEntry(uint64_t key, const std::vector<std::byte>& data) const;
+
+    [[nodiscard]] std::vector<std::vector<std::byte>> SerializeOnDevice(const std::vector<BottomLevelAccelerationStructure*>& structures) const;
+    [[nodiscard]] std::vector<std::vector<std::byte>> SerializeOnHost(const std::vector<BottomLevelAccelerationStructure*>& structures) const;
+
+    // Addresses of serialized data passed to the device copies have to be aligned to this
+    static constexpr vk::DeviceSize SERIALIZED_DATA_ALIGNMENT = 256;
+
+    std::filesystem::path _directory;
+    std::shared_ptr<VulkanContext> _vulkanContext;
+};
@@ -1,15 +1,45 @@
 #pragma once
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 #include "common.hpp"
 
 class VulkanContext;
 class Renderer;
 class SDL_Window;
+enum class RenderQuality : uint8_t;
+enum class BLASGranularity : uint8_t;
+
+struct ApplicationSettings
+{
+    bool headless = false;
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    uint32_t sampleBudget = 1000;
+    // Defaults to preview when interactive and production when headless
+    std::optional<RenderQuality> quality {};
+    // Relative error at which pixels stop receiving samples, 0 disables adaptive sampling
+    float convergenceThreshold = 0.01f;
+    // Defaults to a structure per mesh
+    std::optional<BLASGranularity> blasGranularity {};
+    // Defaults to the renderer's cache directory, an empty path disables the cache
+    std::optional<std::string> blasCacheDirectory {};
+    // Defaults to the renderer's cache directory for compressed textures, an empty path disables the cache
+    std::optional<std::string> textureCacheDirectory {};
+    // Defaults to the renderer's cache directory for imported scenes, an empty path disables the cache
+    std::optional<std::string> sceneCacheDirectory {};
+    std::string outputPath = "output.png";
+    std::string batchManifestPath {};
+    std::vector<std::string> scene = { "assets/cornell/CornellBox-Original.gltf" };
+
+    static ApplicationSettings FromArguments(int argc, char* argv[]);
+};
 
 class Application
 {
 public:
-    Application();
+    explicit Application(const ApplicationSettings& settings);
     ~Application();
     NON_COPYABLE(Application);
     NON_MOVABLE(Application);
@@ -17,10 +47,14 @@ public:
     int Run();
 
 private:
+    void InitializeWindowed();
+    void InitializeHeadless();
     void MainLoopOnce();
 
+    ApplicationSettings _settings;
     std::shared_ptr<VulkanContext> _vulkanContext;
     std::unique_ptr<Renderer> _renderer;
     SDL_Window* _window = nullptr;
     bool _exitRequested = false;
-};
\ No newline at end of file
+    bool _sceneLoaded = false;
+};
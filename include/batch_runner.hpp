@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "common.hpp"
+
+class VulkanContext;
+class Renderer;
+enum class RenderQuality : uint8_t;
+
+struct RenderJob
+{
+    std::vector<std::string> scene {};
+    glm::vec3 cameraPosition { 0.0f, 1.0f, 3.0f };
+    glm::vec3 cameraTarget { 0.0f, 1.0f, 0.0f };
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    uint32_t sampleBudget = 1000;
+    // Production quality is used when not specified
+    std::optional<RenderQuality> quality {};
+    // Relative error at which pixels stop receiving samples, 0 disables adaptive sampling
+    float convergenceThreshold = 0.01f;
+    std::string outputPath {};
+};
+
+// Renders a list of jobs headless, consecutive jobs with the same scene share the loaded scene.
+// The manifest contains one job per line, made out of whitespace separated key=value pairs:
+// scene=<path> (repeatable) camera=x,y,z target=x,y,z resolution=WxH samples=N quality=<preview|production|reference> convergence=E output=<path>
+// Empty lines and lines starting with '#' are ignored.
+class BatchRunner
+{
+public:
+    explicit BatchRunner(std::string_view manifestPath);
+    ~BatchRunner();
+    NON_COPYABLE(BatchRunner);
+    NON_MOVABLE(BatchRunner);
+
+    int Run();
+
+    [[nodiscard]] static std::vector<RenderJob> ParseManifest(std::string_view manifestPath);
+
+private:
+    bool RunJob(const RenderJob& job);
+
+    std::vector<RenderJob> _jobs {};
+    std::shared_ptr<VulkanContext> _vulkanContext;
+    std::unique_ptr<Renderer> _renderer;
+};
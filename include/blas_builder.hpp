@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "common.hpp"
+
+class VulkanContext;
+class BottomLevelAccelerationStructure;
+class ThreadPool;
+class AccelerationStructureCache;
+class AccelerationStructureArena;
+
+// Records the builds of many bottom level acceleration structures into a single submission.
+// Builds share one scratch pool, structures that don't fit next to each other are split over multiple build calls
+// with a barrier in between, so the next batch can reuse the scratch memory.
+// With compaction enabled every structure is copied into a right-sized one afterwards, releasing the worst case allocation.
+// Structures created for host builds are built on the CPU instead, with the work of every batch spread over the thread pool.
+// With a cache set, structures are restored from it when possible and the ones that had to be built are added to it.
+class BLASBuilder
+{
+public:
+    // Compacted structures are placed in the arena, the scratch pool is allocated for each Build() and released afterwards
+    BLASBuilder(const std::shared_ptr<VulkanContext>& vulkanContext, const std::shared_ptr<ThreadPool>& threadPool, const std::shared_ptr<AccelerationStructureArena>& arena);
+    ~BLASBuilder() = default;
+    NON_COPYABLE(BLASBuilder);
+    NON_MOVABLE(BLASBuilder);
+
+    // The structure has to stay at the same address until Build() returns, all pending structures need the same build type
+    void Add(BottomLevelAccelerationStructure& blas);
+    void SetCompaction(bool compact) { _compact = compact; }
+    void SetCache(const std::shared_ptr<AccelerationStructureCache>& cache) { _cache = cache; }
+    // Submits all pending builds and waits for them to finish
+    void Build();
+
+private:
+    // Pending structures that are built next to each other in the scratch pool
+    struct BuildBatch
+    {
+        size_t first {};
+        size_t count {};
+    };
+
+    // Both return the compacted sizes when compaction is enabled
+    [[nodiscard]] std::vector<vk::DeviceSize> BuildOnDevice(const std::vector<BuildBatch>& batches, const std::vector<vk::DeviceSize>& scratchOffsets, vk::DeviceSize poolSize);
+    [[nodiscard]] std::vector<vk::DeviceSize> BuildOnHost(const std::vector<BuildBatch>& batches, const std::vector<vk::DeviceSize>& scratchOffsets, vk::DeviceSize poolSize);
+    [[nodiscard]] vk::AccelerationStructureBuildGeometryInfoKHR BuildGeometryInfo(size_t pendingIndex) const;
+    // Covers everything that affects the built structure: its input, the build flags and where it's built
+    [[nodiscard]] uint64_t CacheKey(size_t pendingIndex) const;
+    void RestoreFromCache(std::vector<uint64_t>& cacheKeys);
+    void JoinDeferredOperation(vk::DeferredOperationKHR operation, vk::Result result);
+    void Compact(const std::vector<vk::DeviceSize>& compactedSizes, bool hostBuild);
+
+    // Upper bound for the scratch pool, unless a single structure needs more than this by itself
+    static constexpr vk::DeviceSize SCRATCH_POOL_SIZE = 64 * 1024 * 1024;
+
+    std::shared_ptr<VulkanContext> _vulkanContext;
+    std::shared_ptr<ThreadPool> _threadPool;
+    std::shared_ptr<AccelerationStructureArena> _arena;
+    std::shared_ptr<AccelerationStructureCache> _cache;
+    std::vector<BottomLevelAccelerationStructure*> _pending {};
+    bool _compact = false;
+};
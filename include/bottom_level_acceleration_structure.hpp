@@ -1,37 +1,76 @@
 #pragma once
 #include "acceleration_structure.hpp"
+#include "bounds.hpp"
 #include "resources/gpu_resources.hpp"
 #include "common.hpp"
 #include <glm/mat4x4.hpp>
+#include <vector>
 
 class VulkanContext;
 class BindlessResources;
 struct Model;
 struct Buffer;
 
+// Geometries in object space, the transform is applied by the TLAS instances referencing it.
+// Geometries can be placed inside the structure with their own transform, e.g. when merging the nodes of a model.
 struct BLASInput
 {
-    glm::mat4 transform {};
-    GeometryNodeCreation node {};
-    vk::AccelerationStructureGeometryKHR geometry {};
-    vk::AccelerationStructureBuildRangeInfoKHR info {};
+    std::vector<GeometryNodeCreation> nodes {};
+    std::vector<vk::AccelerationStructureGeometryKHR> geometries {};
+    std::vector<vk::AccelerationStructureBuildRangeInfoKHR> infos {};
+    // Either empty or one per geometry
+    std::vector<glm::mat4> transforms {};
+    // Host builds take host addresses for the vertices and indices, and place the structure in host visible memory
+    vk::AccelerationStructureBuildTypeKHR buildType = vk::AccelerationStructureBuildTypeKHR::eDevice;
+    // Combined hash of the geometries and their transforms, identifies the structure in the cache
+    uint64_t contentHash {};
+    // Of all geometries, in the space of the structure
+    Bounds bounds {};
 };
 
+// Only allocates the structure, placed in the arena, the build itself is recorded by a BLASBuilder together with the other pending structures
 class BottomLevelAccelerationStructure : public AccelerationStructure
 {
 public:
-    BottomLevelAccelerationStructure(const BLASInput& input, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext);
+    BottomLevelAccelerationStructure(const BLASInput& input, const std::shared_ptr<AccelerationStructureArena>& arena, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext);
     ~BottomLevelAccelerationStructure();
     BottomLevelAccelerationStructure(BottomLevelAccelerationStructure&& other) noexcept;
     BottomLevelAccelerationStructure& operator=(BottomLevelAccelerationStructure&& other) = delete;
     NON_COPYABLE(BottomLevelAccelerationStructure);
 
     [[nodiscard]] vk::AccelerationStructureKHR Structure() const { return _vkStructure; }
-    [[nodiscard]] const glm::mat4& Transform() const { return _transform; }
+    // Index of the geometry node of the first geometry, the rest follow in order of their geometry index
+    [[nodiscard]] uint32_t FirstGeometryIndex() const { return _firstGeometryIndex; }
+
+    [[nodiscard]] vk::AccelerationStructureBuildTypeKHR BuildType() const { return _input.buildType; }
+    [[nodiscard]] uint64_t ContentHash() const { return _input.contentHash; }
+    [[nodiscard]] const Bounds& LocalBounds() const { return _input.bounds; }
+    [[nodiscard]] vk::DeviceSize StructureSize() const { return _storage.size; }
+    [[nodiscard]] vk::DeviceSize BuildScratchSize() const { return _buildScratchSize; }
+    // Scratch data is left for the builder to fill in
+    [[nodiscard]] vk::AccelerationStructureBuildGeometryInfoKHR BuildGeometryInfo() const;
+    // One per geometry
+    [[nodiscard]] const vk::AccelerationStructureBuildRangeInfoKHR* BuildRangeInfos() const { return _input.infos.data(); }
+
+    // Records a compacting copy into a structure of the queried compacted size, which replaces this one right away.
+    // Host built structures are copied on the spot instead, the command buffer is ignored for them
+    [[nodiscard]] RetiredAccelerationStructure Compact(vk::CommandBuffer commandBuffer, vk::DeviceSize compactedSize);
+    // Same as Compact, but restores the structure from serialized data instead of building it
+    [[nodiscard]] RetiredAccelerationStructure Deserialize(vk::CommandBuffer commandBuffer, vk::DeviceOrHostAddressConstKHR data, vk::DeviceSize structureSize);
 
 private:
-    void InitializeStructure(const BLASInput& input);
+    void InitializeTransforms();
+    void InitializeStructure();
+    void AllocateStructure(vk::DeviceSize size);
 
-    glm::mat4 _transform {};
+    uint32_t _firstGeometryIndex {};
+    // Referenced by the build info, so it has to outlive the build
+    BLASInput _input {};
+    vk::DeviceSize _buildScratchSize {};
+    // Declared first, as it has to outlive the storage allocated from it
+    std::shared_ptr<AccelerationStructureArena> _arena;
+    AccelerationStructureAllocation _storage {};
+    // Build input for the transforms of the geometries, when they have any
+    std::unique_ptr<Buffer> _transformBuffer;
     std::shared_ptr<VulkanContext> _vulkanContext;
 };
@@ -0,0 +1,46 @@
+#pragma once
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstdint>
+#include <limits>
+
+// Axis aligned bounding box, empty until a point is added
+struct Bounds
+{
+    glm::vec3 min { std::numeric_limits<float>::max() };
+    glm::vec3 max { std::numeric_limits<float>::lowest() };
+
+    [[nodiscard]] bool Empty() const { return min.x > max.x; }
+    [[nodiscard]] float Diagonal() const { return Empty() ? 0.0f : glm::length(max - min); }
+
+    void Grow(const glm::vec3& point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Grow(const Bounds& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Bounds of the transformed corners, which contain everything the original bounds contained
+    [[nodiscard]] Bounds Transformed(const glm::mat4& transform) const
+    {
+        Bounds transformed {};
+        if (Empty())
+        {
+            return transformed;
+        }
+
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            const glm::vec3 point { corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z };
+            transformed.Grow(glm::vec3(transform * glm::vec4(point, 1.0f)));
+        }
+        return transformed;
+    }
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include "common.hpp"
+#include "texture_compression.hpp"
+
+// Block compressed textures on disk, one file per texture named after the hash of its source file and compression.
+// Entries are independent files, so they can be read and written from the threads that encode the textures
+class CompressedTextureCache
+{
+public:
+    explicit CompressedTextureCache(const std::filesystem::path& directory);
+    ~CompressedTextureCache() = default;
+    NON_COPYABLE(CompressedTextureCache);
+    NON_MOVABLE(CompressedTextureCache);
+
+    [[nodiscard]] std::optional<TextureData> Load(uint64_t key) const;
+    void Store(uint64_t key, const TextureData& texture) const;
+
+private:
+    // Stored in front of the texture data, the version changes whenever the encoders produce different blocks
+    struct EntryHeader
+    {
+        uint32_t magic {};
+        uint32_t version {};
+        uint32_t format {};
+        uint32_t width {};
+        uint32_t height {};
+        uint32_t mipLevels {};
+        uint64_t dataSize {};
+    };
+
+    static constexpr uint32_t ENTRY_MAGIC = 0x58544342; // "BCTX"
+    static constexpr uint32_t ENTRY_VERSION = 1;
+
+    [[nodiscard]] std::filesystem::path EntryPath(uint64_t key) const;
+
+    std::filesystem::path _directory;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+
+// Non-cryptographic 64-bit hash, stable between runs so it can be used to key data stored on disk
+[[nodiscard]] uint64_t HashBytes(std::span<const std::byte> data, uint64_t seed = 0);
+
+template <typename T>
+    requires std::is_trivially_copyable_v<T>
+[[nodiscard]] uint64_t HashSpan(std::span<const T> data, uint64_t seed = 0)
+{
+    return HashBytes(std::as_bytes(data), seed);
+}
+
+// Order dependent, so combining the same values in another order gives another hash
+[[nodiscard]] constexpr uint64_t HashCombine(uint64_t seed, uint64_t value)
+{
+    uint64_t hash = seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2));
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return hash;
+}
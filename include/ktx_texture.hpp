@@ -0,0 +1,11 @@
+#pragma once
+#include <span>
+#include "texture_compression.hpp"
+
+// Whether the bytes start with the KTX2 file identifier
+[[nodiscard]] bool IsKTX2(std::span<const std::byte> bytes);
+
+// Reads the mip chain of a 2D KTX2 texture as it's stored, so it can be uploaded without decoding or encoding it on the CPU.
+// Basis Universal payloads (KHR_texture_basisu) are transcoded into the format of the compression instead, which only
+// rearranges their blocks. Empty data when the file is invalid or holds a format that can't be uploaded
+[[nodiscard]] TextureData LoadKTX2(std::span<const std::byte> bytes, TextureCompression compression);
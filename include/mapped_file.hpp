@@ -0,0 +1,26 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include "common.hpp"
+
+// Read only view of a whole file mapped into memory, pages are only read from disk when they are touched
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+    NON_COPYABLE(MappedFile);
+    NON_MOVABLE(MappedFile);
+
+    // False when the file doesn't exist, is empty or couldn't be mapped
+    [[nodiscard]] bool IsOpen() const { return !_data.empty(); }
+    [[nodiscard]] std::span<const std::byte> Data() const { return _data; }
+
+private:
+    std::span<const std::byte> _data {};
+#if defined(_WIN32)
+    // POSIX mappings stay valid after the file is closed, Windows needs the file and mapping object to stay open
+    void* _fileHandle = nullptr;
+    void* _mappingHandle = nullptr;
+#endif
+};
@@ -1,13 +1,22 @@
 #pragma once
+#include "bounds.hpp"
 #include "common.hpp"
+#include "resources/gpu_resources.hpp"
 #include "resources/resource_manager.hpp"
-#include <assimp/Importer.hpp>
+#include "texture_compression.hpp"
+#include <array>
 #include <glm/vec3.hpp>
 #include <glm/matrix.hpp>
+#include <limits>
+#include <span>
 #include <unordered_map>
 
 class VulkanContext;
 class BindlessResources;
+class ThreadPool;
+class CompressedTextureCache;
+class SceneCache;
+struct ImportedModel;
 struct aiScene;
 struct Buffer;
 struct Image;
@@ -29,6 +38,12 @@ struct Mesh
     uint32_t firstIndex {};
     uint32_t firstVertex {};
     ResourceHandle<Material> material {};
+    // Identifies the positions and triangles, which is all an acceleration structure is built from
+    uint64_t geometryHash {};
+    // Object space bounds of the triangles
+    Bounds bounds {};
+    // Object space triangles when the material is emissive, the renderer places them with the instances referencing the mesh
+    std::vector<EmissiveTriangleCreation> emissiveTriangles {};
 };
 
 struct Model
@@ -44,6 +59,9 @@ struct Model
     std::unique_ptr<Buffer> indexBuffer;
     uint32_t verticesCount {};
     uint32_t indexCount {};
+    // CPU copies of the buffers, only kept as input for host acceleration structure builds
+    std::vector<Vertex> vertices {};
+    std::vector<uint32_t> indices {};
 
     std::vector<Node> nodes {};
     std::vector<Mesh> meshes {};
@@ -51,21 +69,88 @@ struct Model
     std::vector<ResourceHandle<Material>> materials {};
 };
 
+// Marks a mesh without material or a material slot without texture
+constexpr uint32_t SCENE_INDEX_NONE = std::numeric_limits<uint32_t>::max();
+
+// Texture file of a scene, relative to the directory of the model file
+struct SceneTexture
+{
+    std::string path {};
+    // For all the ways the materials use it, devices without BC support fall back to uncompressed textures when it's loaded
+    TextureCompression compression {};
+};
+
+struct SceneMaterial
+{
+    static constexpr size_t TEXTURE_SLOTS = 5;
+
+    // Albedo, metallic-roughness, normal, occlusion and emissive textures, as indices into the textures of the scene
+    std::array<uint32_t, TEXTURE_SLOTS> textures { SCENE_INDEX_NONE, SCENE_INDEX_NONE, SCENE_INDEX_NONE, SCENE_INDEX_NONE, SCENE_INDEX_NONE };
+    // Factors of the material, the maps are set once the textures are loaded
+    MaterialCreation creation {};
+};
+
+struct SceneMesh
+{
+    uint32_t indexCount {};
+    uint32_t firstIndex {};
+    uint32_t firstVertex {};
+    uint32_t material = SCENE_INDEX_NONE;
+    uint64_t geometryHash {};
+};
+
+// Contents of a model file before any resources are created for it, imported with Assimp or read from the scene cache.
+// The vertices and indices are views into the storage of whichever produced them. Only movable, as nodes point at their parents
+struct SceneData
+{
+    SceneData() = default;
+    NON_COPYABLE(SceneData);
+    SceneData(SceneData&&) = default;
+    SceneData& operator=(SceneData&&) = default;
+
+    std::string name {};
+    std::span<const Model::Vertex> vertices {};
+    std::span<const uint32_t> indices {};
+    std::vector<Node> nodes {};
+    std::vector<SceneMesh> meshes {};
+    std::vector<SceneMaterial> materials {};
+    std::vector<SceneTexture> textures {};
+};
+
 class ModelLoader
 {
 public:
-    ModelLoader(const std::shared_ptr<BindlessResources>& bindlessResources, const std::shared_ptr<VulkanContext>& vulkanContext);
+    // Models are imported and textures are decoded on the thread pool
+    ModelLoader(const std::shared_ptr<BindlessResources>& bindlessResources, const std::shared_ptr<ThreadPool>& threadPool, const std::shared_ptr<VulkanContext>& vulkanContext);
     ~ModelLoader() = default;
     NON_COPYABLE(ModelLoader);
     NON_MOVABLE(ModelLoader);
 
-    [[nodiscard]] std::shared_ptr<Model> LoadFromFile(std::string_view path);
+    // Imports the models concurrently, each reading its scene cache entry when it's up to date, or importing the file and storing
+    // the entry otherwise. Resources are registered on the calling thread in the order of the paths, which can't be a thread
+    // of the pool as it waits for the imports. Null for the models that failed to load
+    [[nodiscard]] std::vector<std::shared_ptr<Model>> LoadFromFiles(const std::vector<std::string>& paths);
+    // Has to be called when the images are released, after which textures are loaded again
+    void ClearTextureCache();
+    // Block compressed textures are stored in this directory and read back on later runs, an empty path disables the cache
+    void SetCompressedTextureCacheDirectory(std::string_view directory);
+    // Imported scenes are stored in this directory and mapped on later loads instead of importing them again, an empty path disables the cache
+    void SetSceneCacheDirectory(std::string_view directory);
 
 private:
-    [[nodiscard]] std::shared_ptr<Model> ProcessModel(const aiScene* scene, const std::string_view directory);
+    // Registers the materials of an imported model, once its textures are loaded
+    [[nodiscard]] std::shared_ptr<Model> CreateModel(ImportedModel& imported, const std::string_view directory);
+    // Decodes and compresses the textures on the thread pool, skipping the ones that are already loaded
+    void LoadTextures(const std::vector<std::pair<std::string, TextureCompression>>& paths);
 
-    Assimp::Importer _importer {};
-    std::unordered_map<std::string_view, ResourceHandle<Image>> _imageCache {};
+    // Images shared by all loaded models, by the path of their file and by the hash of its content, so
+    // a texture that is referenced by many models, or copied next to each of them, is only decoded once
+    std::unordered_map<std::string, ResourceHandle<Image>> _texturesByPath {};
+    std::unordered_map<uint64_t, ResourceHandle<Image>> _texturesByContent {};
     std::shared_ptr<VulkanContext> _vulkanContext;
     std::shared_ptr<BindlessResources> _bindlessResources;
+    std::shared_ptr<ThreadPool> _threadPool;
+    // Shared with the encoding tasks on the thread pool
+    std::shared_ptr<CompressedTextureCache> _compressedTextureCache;
+    std::shared_ptr<SceneCache> _sceneCache;
 };
@@ -1,11 +1,14 @@
 #pragma once
 #include <memory>
+#include <optional>
+#include <string_view>
 #include <vulkan/vulkan.hpp>
 #include <glm/mat4x4.hpp>
 #include "vk_common.hpp"
 #include "common.hpp"
 #include "model_loader.hpp"
 #include "bottom_level_acceleration_structure.hpp"
+#include "top_level_acceleration_structure.hpp"
 
 struct VulkanInitInfo;
 struct Buffer;
@@ -16,6 +19,48 @@ class ModelLoader;
 class BottomLevelAccelerationStructure;
 class TopLevelAccelerationStructure;
 class BindlessResources;
+class ThreadPool;
+class AccelerationStructureCache;
+class AccelerationStructureArena;
+
+enum class RenderQuality : uint8_t
+{
+    ePreview,
+    eProduction,
+    eReference,
+    eCount
+};
+
+// Passed to ray_gen.rgen and closest_hit.rchit as specialization constants, so the layout has to match the constant ids there
+struct PathTracingSettings
+{
+    uint32_t samplesPerLaunch = 25;
+    uint32_t maxDepth = 10;
+    float tMin = 0.001f;
+    float tMax = 10000.0f;
+    float hitStrength = 2.5f;
+    // Paths are terminated with Russian roulette after this many bounces, based on their throughput
+    uint32_t rouletteMinDepth = 3;
+    // Caps the survival probability, so paths with full throughput (e.g. between white walls) still end eventually
+    float rouletteMaxSurvival = 0.95f;
+
+    [[nodiscard]] static PathTracingSettings FromQuality(RenderQuality quality);
+};
+
+[[nodiscard]] std::optional<RenderQuality> ParseRenderQuality(std::string_view name);
+
+// How the meshes of a model are grouped into bottom level acceleration structures
+enum class BLASGranularity : uint8_t
+{
+    // One structure per mesh, instanced by every node that uses it
+    eMesh,
+    // The meshes of a node merged into one structure, shared by nodes with the same meshes
+    eNode,
+    // All nodes of a model merged into a single structure, with the node transforms baked into its geometries
+    eModel
+};
+
+[[nodiscard]] std::optional<BLASGranularity> ParseBLASGranularity(std::string_view name);
 
 class Renderer
 {
@@ -27,7 +72,43 @@ public:
 
     void Render();
 
+    // Reuses the loaded models and acceleration structures when the same scene is requested again
+    bool LoadScene(const std::vector<std::string>& scene);
+    void SetCamera(const glm::vec3& position, const glm::vec3& target);
+    // Moves an instance of the loaded scene, the acceleration structure is refit with the next frame
+    void SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform);
+    [[nodiscard]] uint32_t InstanceCount() const { return static_cast<uint32_t>(_tlasInstances.size()); }
+    // Switches between the prebuilt pipeline variants, which restarts the accumulation
+    void SetQuality(RenderQuality quality);
+    // Relative error of a pixel below which it stops receiving samples, 0 disables adaptive sampling
+    void SetConvergenceThreshold(float threshold);
+    // Applies to scenes loaded afterwards, a scene that is already loaded gets rebuilt when it's requested again
+    void SetBLASGranularity(BLASGranularity granularity);
+    // Built structures are serialized into this directory and restored on later runs, an empty path disables the cache
+    void SetBLASCacheDirectory(std::string_view directory);
+    // Textures are block compressed once and read from this directory on later runs, an empty path disables the cache
+    void SetTextureCacheDirectory(std::string_view directory);
+    // Imported models are stored in this directory and mapped on later runs instead of importing them again, an empty path disables the cache
+    void SetSceneCacheDirectory(std::string_view directory);
+    // Only available when rendering headless, as the swap chain dictates the size otherwise
+    void Resize(uint32_t width, uint32_t height);
+
+    // Renders frames without presenting, until the sample budget per pixel is reached or all pixels converged
+    void RenderOffscreen(uint32_t sampleBudget);
+    // True once every pixel is below the convergence threshold, lags a few frames behind as it's read back from the GPU
+    [[nodiscard]] bool IsConverged() const;
+    // Writes the display image, or the unclamped accumulated radiance when saving to .hdr
+    bool SaveRenderTarget(std::string_view path);
+
 private:
+    // Has to match ADAPTIVE_TILE_SIZE in accumulation.glsl, which is also the workgroup size in resolve.comp
+    static constexpr uint32_t ADAPTIVE_TILE_SIZE = 8;
+    // Launches every pixel receives before its variance estimate is trusted
+    static constexpr uint32_t ADAPTIVE_MIN_FRAMES = 4;
+    static constexpr std::string_view DEFAULT_BLAS_CACHE_DIRECTORY = "cache/blas";
+    static constexpr std::string_view DEFAULT_TEXTURE_CACHE_DIRECTORY = "cache/textures";
+    static constexpr std::string_view DEFAULT_SCENE_CACHE_DIRECTORY = "cache/scenes";
+
     struct CameraUniformData
     {
         glm::mat4 viewInverse {};
@@ -37,19 +118,52 @@ private:
     struct PushConstantData
     {
         uint32_t frameIndex {};
+        uint32_t adaptive {};
+        float convergenceThreshold {};
+        uint32_t adaptiveMinFrames {};
+    };
+
+    // Matches the start of the AdaptiveTiles buffer in accumulation.glsl, followed by the list of tiles
+    struct AdaptiveTilesHeader
+    {
+        vk::TraceRaysIndirectCommandKHR command {};
+        uint32_t unconvergedPixels {};
+    };
+
+    struct PathTracingPipeline
+    {
+        PathTracingSettings settings {};
+        vk::Pipeline pipeline;
+
+        std::unique_ptr<Buffer> raygenSBT;
+        std::unique_ptr<Buffer> missSBT;
+        std::unique_ptr<Buffer> hitSBT;
+        vk::StridedDeviceAddressRegionKHR raygenAddressRegion {};
+        vk::StridedDeviceAddressRegionKHR missAddressRegion {};
+        vk::StridedDeviceAddressRegionKHR hitAddressRegion {};
     };
 
     void RecordCommands(const vk::CommandBuffer& commandBuffer, uint32_t swapChainImageIndex);
     void InitializeCommandBuffers();
     void InitializeSynchronizationObjects();
     void InitializeRenderTarget();
+    void InitializeConvergenceReadback();
 
     void InitializeCamera();
     void InitializeDescriptorSets();
     void InitializePipeline();
-    void InitializeShaderBindingTable();
+    void InitializeResolvePipeline();
+    void InitializeShaderBindingTable(PathTracingPipeline& pathTracingPipeline);
 
     void InitializeBLAS();
+    // Places the emissive triangles of all instances in the scene for light sampling, they're uploaded with the descriptor set
+    void UpdateEmissiveTriangles();
+    void UnloadScene();
+    void UpdateCamera();
+    void UpdateDescriptorSets();
+    void ResetAccumulation();
+    void ReadConvergenceStatistics(uint32_t resourcesFrame);
+    std::vector<std::byte> ReadbackImage(const Image& image, vk::ImageLayout currentLayout, vk::DeviceSize size);
 
     std::shared_ptr<VulkanContext> _vulkanContext;
     std::unique_ptr<SwapChain> _swapChain;
@@ -57,15 +171,40 @@ private:
     std::array<vk::Semaphore, MAX_FRAMES_IN_FLIGHT> _imageAvailableSemaphores;
     std::array<vk::Semaphore, MAX_FRAMES_IN_FLIGHT> _renderFinishedSemaphores;
     std::array<vk::Fence, MAX_FRAMES_IN_FLIGHT> _inFlightFences;
+    // Radiance is summed in floating point, with the amount of frames in alpha, and resolved into the 8-bit render target
+    std::unique_ptr<Image> _accumulationTarget;
+    std::unique_ptr<Image> _momentTarget;
     std::unique_ptr<Image> _renderTarget;
 
     uint32_t _renderedFrames = 0;
-
+    uint32_t _accumulatedFrames = 0;
+
+    // Rebuilt by the resolve pass every frame, with the tiles that still need samples
+    std::unique_ptr<Buffer> _adaptiveTileBuffer;
+    std::array<std::unique_ptr<Buffer>, MAX_FRAMES_IN_FLIGHT> _convergenceReadbackBuffers;
+    // Accumulated frame (offset by one) each readback buffer was recorded for, 0 when it holds nothing valid
+    std::array<uint32_t, MAX_FRAMES_IN_FLIGHT> _convergenceReadbackFrames {};
+    std::optional<uint32_t> _unconvergedPixels {};
+    float _convergenceThreshold = 0.01f;
+
+    // Shared by the CPU side work, e.g. joining host acceleration structure builds
+    std::shared_ptr<ThreadPool> _threadPool;
     std::unique_ptr<ModelLoader> _modelLoader;
     std::shared_ptr<BindlessResources> _bindlessResources;
 
+    std::vector<std::string> _scene {};
     std::vector<std::shared_ptr<Model>> _models {};
+    // Storage of all bottom level structures, host visible when they are built on the host
+    std::shared_ptr<AccelerationStructureArena> _blasArena;
+    // Unique meshes, placed in the scene by the instances
     std::vector<BottomLevelAccelerationStructure> _blases {};
+    std::vector<TLASInstance> _tlasInstances {};
+    // Emissive triangles of each instance, relative to its transform
+    std::vector<std::vector<EmissiveTriangleCreation>> _instanceEmissiveTriangles {};
+    BLASGranularity _blasGranularity = BLASGranularity::eMesh;
+    std::shared_ptr<AccelerationStructureCache> _blasCache;
+    // Set when instances moved since the TLAS was last updated
+    bool _instancesDirty = false;
     std::unique_ptr<TopLevelAccelerationStructure> _tlas;
 
     vk::DescriptorPool _descriptorPool;
@@ -73,16 +212,13 @@ private:
     vk::DescriptorSet _descriptorSet;
 
     std::unique_ptr<Buffer> _uniformBuffer;
-
-    std::unique_ptr<Buffer> _raygenSBT;
-    std::unique_ptr<Buffer> _missSBT;
-    std::unique_ptr<Buffer> _hitSBT;
-    vk::StridedDeviceAddressRegionKHR _raygenAddressRegion {};
-    vk::StridedDeviceAddressRegionKHR _missAddressRegion {};
-    vk::StridedDeviceAddressRegionKHR _hitAddressRegion {};
+    glm::vec3 _cameraPosition { 0.0f, 1.0f, 3.0f };
+    glm::vec3 _cameraTarget { 0.0f, 1.0f, 0.0f };
 
     vk::PipelineLayout _pipelineLayout;
-    vk::Pipeline _pipeline;
+    std::array<PathTracingPipeline, static_cast<size_t>(RenderQuality::eCount)> _pipelines {};
+    RenderQuality _quality = RenderQuality::eProduction;
+    vk::Pipeline _resolvePipeline;
 
     uint32_t _windowWidth = 0;
     uint32_t _windowHeight = 0;
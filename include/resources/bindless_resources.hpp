@@ -5,15 +5,17 @@
 #include <vulkan/vulkan.hpp>
 
 class VulkanContext;
+class UploadManager;
 
 class ImageResources : public ResourceManager<Image>
 {
 public:
-    explicit ImageResources(const std::shared_ptr<VulkanContext>& vulkanContext);
+    ImageResources(const std::shared_ptr<VulkanContext>& vulkanContext, const std::shared_ptr<UploadManager>& uploadManager);
     ResourceHandle<Image> Create(const ImageCreation& creation);
 
 private:
     std::shared_ptr<VulkanContext> _vulkanContext;
+    std::shared_ptr<UploadManager> _uploadManager;
 };
 
 class MaterialResources : public ResourceManager<Material>
@@ -33,6 +35,13 @@ public:
     ResourceHandle<GeometryNode> Create(const GeometryNodeCreation& creation);
 };
 
+class EmissiveTriangleResources : public ResourceManager<EmissiveTriangle>
+{
+public:
+    EmissiveTriangleResources() = default;
+    ResourceHandle<EmissiveTriangle> Create(const EmissiveTriangleCreation& creation);
+};
+
 class BLASInstanceResources : public ResourceManager<BLASInstance>
 {
 public:
@@ -46,10 +55,17 @@ public:
     explicit BindlessResources(const std::shared_ptr<VulkanContext>& vulkanContext);
     ~BindlessResources();
     void UpdateDescriptorSet();
+    // Only rebuilds the light list, for when the emissive triangles changed after the scene was loaded
+    void UploadEmissiveTriangles();
+    // Releases all scene resources, only the fallback resources are kept
+    void Clear();
     [[nodiscard]] ImageResources& Images() { return _imageResources; }
     [[nodiscard]] MaterialResources& Materials() { return _materialResources; }
     [[nodiscard]] GeometryNodeResources& GeometryNodes() { return _geometryNodeResources; }
     [[nodiscard]] BLASInstanceResources& BLASInstances() { return _blasInstanceResources; }
+    [[nodiscard]] EmissiveTriangleResources& EmissiveTriangles() { return _emissiveTriangleResources; }
+    // Staging copies of all scene resources go through here, the transfer timeline signals when they are done
+    [[nodiscard]] UploadManager& Uploads() { return *_uploadManager; }
     [[nodiscard]] const vk::DescriptorSetLayout& DescriptorSetLayout() const { return _bindlessLayout; }
     [[nodiscard]] const vk::DescriptorSet& DescriptorSet() const { return _bindlessSet; }
 
@@ -60,20 +76,34 @@ private:
         eMaterials,
         eGeometryNodes,
         eBLASInstances,
+        eEmissiveTriangles,
+    };
+
+    // Matches the header of the EmissiveTriangles buffer in bindless.glsl
+    struct EmissiveTrianglesHeader
+    {
+        uint32_t count = 0;
+        float totalPower = 0.0f;
+        glm::vec2 _PADDING_ {};
     };
 
     static constexpr uint32_t MAX_RESOURCES = 1024;
+    // Emissive meshes can easily consist of more triangles than there are resources of other types
+    static constexpr uint32_t MAX_EMISSIVE_TRIANGLES = 1 << 16;
 
     std::shared_ptr<VulkanContext> _vulkanContext;
+    std::shared_ptr<UploadManager> _uploadManager;
 
     ImageResources _imageResources;
     MaterialResources _materialResources;
     GeometryNodeResources _geometryNodeResources {};
     BLASInstanceResources _blasInstanceResources {};
+    EmissiveTriangleResources _emissiveTriangleResources {};
 
     std::unique_ptr<Buffer> _materialBuffer;
     std::unique_ptr<Buffer> _geometryNodeBuffer;
     std::unique_ptr<Buffer> _blasInstanceBuffer;
+    std::unique_ptr<Buffer> _emissiveTriangleBuffer;
 
     vk::DescriptorPool _bindlessPool;
     vk::DescriptorSetLayout _bindlessLayout;
@@ -82,6 +112,7 @@ private:
     ResourceHandle<Image> _fallbackImage;
     std::unique_ptr<Sampler> _fallbackSampler;
 
+    void InitializeFallbackImage();
     void UploadImages();
     void UploadMaterials();
     void UploadGeometryNodes();
@@ -90,4 +121,5 @@ private:
     void InitializeMaterialBuffer();
     void InitializeGeometryNodeBuffer();
     void InitializeBLASInstanceBuffer();
+    void InitializeEmissiveTriangleBuffer();
 };
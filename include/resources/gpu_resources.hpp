@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <optional>
+#include <span>
 #include <vulkan/vulkan.hpp>
 #include <vk_mem_alloc.h>
 #include <glm/glm.hpp>
@@ -9,6 +10,7 @@
 #include "resource_manager.hpp"
 
 class VulkanContext;
+class UploadManager;
 
 struct BufferCreation
 {
@@ -78,15 +80,19 @@ private:
 
 struct ImageCreation
 {
-    std::vector<std::byte> data {};
+    // Not owned, only read while the image is created, so decoded pixels don't have to be copied into the creation.
+    // Holds every mip level tightly packed, starting with the full resolution
+    std::span<const std::byte> data {};
     uint32_t width {};
     uint32_t height {};
+    uint32_t mipLevels = 1;
     vk::Format format = vk::Format::eUndefined;
     vk::ImageUsageFlags usage { 0 };
     std::string name {};
 
-    ImageCreation& SetData(const std::vector<std::byte>& data);
+    ImageCreation& SetData(std::span<const std::byte> data);
     ImageCreation& SetSize(uint32_t width, uint32_t height);
+    ImageCreation& SetMipLevels(uint32_t mipLevels);
     ImageCreation& SetFormat(vk::Format format);
     ImageCreation& SetUsageFlags(vk::ImageUsageFlags usage);
     ImageCreation& SetName(std::string_view name);
@@ -94,7 +100,8 @@ struct ImageCreation
 
 struct Image
 {
-    Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>& vulkanContext);
+    // Images with data are uploaded through the upload manager, they can be used once the transfer timeline reaches its next flush
+    Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>& vulkanContext, UploadManager* uploadManager = nullptr);
     ~Image();
     NON_COPYABLE(Image);
     Image(Image&& other) noexcept;
@@ -184,6 +191,8 @@ struct Material
 
 struct GeometryNodeCreation
 {
+    // Places the geometry inside its BLAS, identity unless geometries were merged with their own transform
+    glm::mat4 transform { 1.0f };
     vk::DeviceAddress vertexBufferDeviceAddress = 0;
     vk::DeviceAddress indexBufferDeviceAddress = 0;
     ResourceHandle<Material> material = ResourceHandle<Material>::Null();
@@ -193,12 +202,36 @@ struct GeometryNode
 {
     explicit GeometryNode(const GeometryNodeCreation& creation);
 
+    glm::mat4 transform { 1.0f };
     uint64_t vertexBufferDeviceAddress = 0;
     uint64_t indexBufferDeviceAddress = 0;
     uint32_t materialIndex = NULL_RESOURCE_INDEX_VALUE;
     glm::vec3 _PADDING_{};
 };
 
+struct EmissiveTriangleCreation
+{
+    glm::vec3 p0 {};
+    glm::vec3 p1 {};
+    glm::vec3 p2 {};
+    glm::vec3 emission {};
+};
+
+// World space triangle used for explicit light sampling, the alias entry is filled in when uploading the light list
+struct EmissiveTriangle
+{
+    explicit EmissiveTriangle(const EmissiveTriangleCreation& creation);
+
+    glm::vec3 p0 {};
+    float area = 0.0f;
+    glm::vec3 p1 {};
+    float aliasThreshold = 1.0f;
+    glm::vec3 p2 {};
+    uint32_t alias = 0;
+    glm::vec3 emission {};
+    float _PADDING_ {};
+};
+
 struct BLASInstance
 {
     uint32_t firstGeometryIndex = 0;
@@ -22,6 +22,7 @@ public:
     ResourceManager() = default;
     const T& Get(ResourceHandle<T> handle) const { return _resources[handle.handle]; }
     const std::vector<T>& GetAll() const { return _resources; }
+    void Clear() { _resources.clear(); }
 
 protected:
     ResourceHandle<T> Create(T&& resource)
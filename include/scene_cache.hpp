@@ -0,0 +1,67 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include "common.hpp"
+#include "model_loader.hpp"
+
+class MappedFile;
+
+// Scene read from the cache, its vertices and indices point into the mapped entry
+struct CachedScene
+{
+    std::unique_ptr<MappedFile> file;
+    SceneData scene;
+};
+
+// Imported scenes on disk, one file per model named after the hash of its path. Entries hold the size and modification
+// time of the model file they were imported from, and are imported and stored again when the file changed. Files the
+// model refers to (e.g. the buffers of a .gltf) aren't checked, changing only those needs the entry to be removed.
+class SceneCache
+{
+public:
+    explicit SceneCache(const std::filesystem::path& directory);
+    ~SceneCache() = default;
+    NON_COPYABLE(SceneCache);
+    NON_MOVABLE(SceneCache);
+
+    // Maps the entry of the model file, empty when there is none or it's out of date
+    [[nodiscard]] std::optional<CachedScene> Load(const std::filesystem::path& modelPath) const;
+    void Store(const std::filesystem::path& modelPath, const SceneData& scene) const;
+
+private:
+    // Where a section of the entry starts and how many elements it holds
+    struct Section
+    {
+        uint64_t offset {};
+        uint64_t count {};
+    };
+
+    // Start of every entry, the version changes whenever the layout or the way scenes are imported changes
+    struct EntryHeader
+    {
+        uint32_t magic {};
+        uint32_t version {};
+        uint64_t sourceSize {};
+        int64_t sourceWriteTime {};
+        // Offset into the strings and length of the name
+        Section name {};
+        Section vertices {};
+        Section indices {};
+        Section nodes {};
+        Section nodeMeshes {};
+        Section meshes {};
+        Section materials {};
+        Section textures {};
+        Section strings {};
+    };
+
+    static constexpr uint32_t ENTRY_MAGIC = 0x434E4353; // "SCNC"
+    static constexpr uint32_t ENTRY_VERSION = 1;
+    // Sections start at this alignment, so the mapped vertices and indices can be read in place
+    static constexpr uint64_t SECTION_ALIGNMENT = 16;
+
+    [[nodiscard]] std::filesystem::path EntryPath(const std::filesystem::path& modelPath) const;
+
+    std::filesystem::path _directory;
+};
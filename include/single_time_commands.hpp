@@ -1,25 +1,35 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 #include "common.hpp"
 
 class VulkanContext;
+enum class QueueType : uint8_t;
 
+// Records commands for a single submission to one of the queues, which signals the timeline of that queue when done
 class SingleTimeCommands
 {
 public:
-    SingleTimeCommands(std::shared_ptr<VulkanContext> context);
+    SingleTimeCommands(std::shared_ptr<VulkanContext> context, QueueType queueType);
+    explicit SingleTimeCommands(std::shared_ptr<VulkanContext> context);
     ~SingleTimeCommands();
     NON_MOVABLE(SingleTimeCommands);
     NON_COPYABLE(SingleTimeCommands);
 
     void Record(const std::function<void(vk::CommandBuffer)>& commands) const;
+    // Makes the commands wait on the GPU for earlier work of another queue, e.g. uploads consumed by builds
+    void WaitFor(QueueType queueType, uint64_t timelineValue, vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eAllCommands);
+    // Submits without waiting and returns the timeline value signalled once the commands are done
+    uint64_t Submit();
     void SubmitAndWait();
 
 private:
     std::shared_ptr<VulkanContext> _vulkanContext;
+    QueueType _queueType;
     vk::CommandBuffer _commandBuffer;
-    vk::Fence _fence;
+    std::vector<vk::SemaphoreSubmitInfo> _waits {};
+    uint64_t _timelineValue {};
     bool _submitted = false;
-};
\ No newline at end of file
+};
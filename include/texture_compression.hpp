@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+// Tightly packed mip chain of a texture, laid out the way it's uploaded
+struct TextureData
+{
+    vk::Format format = vk::Format::eUndefined;
+    uint32_t width {};
+    uint32_t height {};
+    uint32_t mipLevels {};
+    std::vector<std::byte> data {};
+};
+
+// Block compressed formats the textures of a model are encoded into, by what they hold.
+// Ordered by the channels they keep, so a texture that is used in multiple ways picks the largest one
+enum class TextureCompression : uint8_t
+{
+    // Kept as RGBA8, for devices without BC support
+    eNone,
+    // Single channel, e.g. occlusion
+    eBC4,
+    // Two channels, e.g. tangent space normals
+    eBC5,
+    // Color with alpha
+    eBC7,
+};
+
+[[nodiscard]] vk::Format TextureCompressionFormat(TextureCompression compression);
+
+// Encodes every level of an RGBA8 mip chain into blocks, edge texels are repeated for levels that aren't a multiple of the block size.
+// BC7 only uses mode 6, a single subset with RGBA endpoints fit along the principal axis of the block, which is fast and holds up well for
+// most color data. Runs on the calling thread, one texture per thread is the intended granularity
+[[nodiscard]] TextureData CompressTexture(const TextureData& texture, TextureCompression compression);
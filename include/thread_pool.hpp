@@ -0,0 +1,55 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "common.hpp"
+
+// Fixed set of worker threads that run submitted tasks in order of submission.
+// Tasks that are still queued on destruction are dropped, which breaks their futures.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency()));
+    ~ThreadPool();
+    NON_COPYABLE(ThreadPool);
+    NON_MOVABLE(ThreadPool);
+
+    template <typename F>
+    [[nodiscard]] std::future<std::invoke_result_t<F>> Submit(F&& task);
+
+    [[nodiscard]] uint32_t ThreadCount() const { return static_cast<uint32_t>(_workers.size()); }
+
+private:
+    void WorkerLoop(const std::stop_token& stopToken);
+
+    std::vector<std::jthread> _workers {};
+    std::queue<std::function<void()>> _tasks {};
+    std::mutex _mutex;
+    std::condition_variable_any _condition;
+};
+
+template <typename F>
+std::future<std::invoke_result_t<F>> ThreadPool::Submit(F&& task)
+{
+    using Result = std::invoke_result_t<F>;
+
+    // std::function has to be copyable, so the move-only packaged task is shared
+    auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packagedTask->get_future();
+
+    {
+        std::scoped_lock lock { _mutex };
+        _tasks.emplace([packagedTask]()
+            { (*packagedTask)(); });
+    }
+    _condition.notify_one();
+
+    return future;
+}
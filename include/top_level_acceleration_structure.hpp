@@ -1,23 +1,63 @@
 #pragma once
 #include "acceleration_structure.hpp"
+#include "bounds.hpp"
 #include "common.hpp"
+#include "vk_common.hpp"
+#include <array>
+#include <glm/mat4x4.hpp>
 
 class VulkanContext;
 class BottomLevelAccelerationStructure;
 class BindlessResources;
 
+// Placement of a bottom level structure in the scene, many instances can share the same structure
+struct TLASInstance
+{
+    uint32_t blasIndex {};
+    glm::mat4 transform {};
+};
+
 class TopLevelAccelerationStructure : public AccelerationStructure
 {
 public:
-    TopLevelAccelerationStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext);
+    TopLevelAccelerationStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::vector<TLASInstance>& instances, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext);
     ~TopLevelAccelerationStructure();
     NON_COPYABLE(TopLevelAccelerationStructure);
     NON_MOVABLE(TopLevelAccelerationStructure);
 
     [[nodiscard]] vk::AccelerationStructureKHR Structure() const { return _vkStructure; }
 
+    // Writes the transforms into the instance buffer of the frame and records a refit of the structure,
+    // or a full rebuild once the instances moved far enough from where they were built to degrade the hierarchy.
+    // The instances have to be the same ones, in the same order, as the structure was created with.
+    void Update(vk::CommandBuffer commandBuffer, uint32_t resourcesFrame, const std::vector<TLASInstance>& instances);
+
 private:
-    void InitializeStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::shared_ptr<BindlessResources>& resources);
+    // Refits keep the topology of the hierarchy, so the nodes above a moved instance stretch to cover both its old
+    // neighbours and its new position. Once the corners of any instance's bounds moved further than this fraction of
+    // the scene's extent at the last build, the nodes are assumed to overlap enough to make a rebuild worth it
+    static constexpr float MAX_DISPLACEMENT_BEFORE_REBUILD = 0.1f;
+
+    // Remembers where the instances are, as the reference for the displacement of later refits
+    void RecordBuildBounds(const std::vector<TLASInstance>& instances);
+    [[nodiscard]] bool RefitDegrades(const std::vector<TLASInstance>& instances) const;
+
+    void InitializeStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::vector<TLASInstance>& instances, const std::shared_ptr<BindlessResources>& resources);
+    [[nodiscard]] vk::AccelerationStructureBuildGeometryInfoKHR BuildGeometryInfo(vk::BuildAccelerationStructureModeKHR mode, uint32_t resourcesFrame);
+
+    std::unique_ptr<Buffer> _structureBuffer;
+    std::vector<vk::AccelerationStructureInstanceKHR> _instances {};
+    // Written by the CPU, so every frame in flight gets its own copy
+    std::array<std::unique_ptr<Buffer>, MAX_FRAMES_IN_FLIGHT> _instanceBuffers;
+    // Sized for both builds and refits
+    std::unique_ptr<Buffer> _scratchBuffer;
+    vk::DeviceAddress _scratchAddress {};
+    // Referenced by the build info, so it has to outlive the build
+    vk::AccelerationStructureGeometryKHR _geometry {};
+    // Bounds of the referenced structures in their own space, and in world space as of the last build
+    std::vector<Bounds> _instanceLocalBounds {};
+    std::vector<Bounds> _instanceBuildBounds {};
+    float _buildSceneExtent = 0.0f;
 
     std::shared_ptr<VulkanContext> _vulkanContext;
 };
@@ -0,0 +1,67 @@
+#pragma once
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include "common.hpp"
+
+class VulkanContext;
+struct Buffer;
+
+// Batches staging copies into few submissions to the transfer queue, instead of a submission and host wait per resource.
+// Data is written into a persistently mapped staging ring, its space is recycled once the transfer timeline reaches the
+// value of the submission that read it. Copies are recorded until the ring runs full or Flush() is called.
+// Other queues wait on TimelineValue(QueueType::eTransfer) of the context to use the uploaded resources.
+class UploadManager
+{
+public:
+    explicit UploadManager(const std::shared_ptr<VulkanContext>& vulkanContext);
+    ~UploadManager();
+    NON_COPYABLE(UploadManager);
+    NON_MOVABLE(UploadManager);
+
+    void UploadBuffer(vk::Buffer buffer, std::span<const std::byte> data, vk::DeviceSize bufferOffset = 0);
+    // Data holds the tightly packed mip levels, the image is left in the shader read only layout
+    void UploadImage(vk::Image image, vk::Format format, uint32_t width, uint32_t height, uint32_t mipLevels, std::span<const std::byte> data);
+
+    // Submits the recorded copies and returns the transfer timeline value that signals their completion
+    uint64_t Flush();
+    void FlushAndWait();
+
+private:
+    // Recorded copies, or copies in flight once submitted
+    struct Batch
+    {
+        vk::CommandBuffer commandBuffer {};
+        uint64_t timelineValue {};
+        // Ring position after the last allocation of the batch, which becomes the tail once it's retired
+        vk::DeviceSize ringEnd {};
+        vk::DeviceSize ringBytes {};
+        // Uploads that are larger than the whole ring get a staging buffer of their own
+        std::vector<std::unique_ptr<Buffer>> dedicatedBuffers {};
+    };
+
+    [[nodiscard]] std::pair<vk::Buffer, vk::DeviceSize> Stage(std::span<const std::byte> data);
+    [[nodiscard]] bool TryAllocate(vk::DeviceSize size, vk::DeviceSize& offset);
+    [[nodiscard]] vk::CommandBuffer RecordingCommandBuffer();
+    uint64_t FlushLocked();
+    void RetireCompleted(bool waitForOldest);
+
+    static constexpr vk::DeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+    // Covers the texel size of every format and the offset alignment of buffer to image copies
+    static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+    std::shared_ptr<VulkanContext> _vulkanContext;
+    std::unique_ptr<Buffer> _stagingRing;
+    std::byte* _stagingData = nullptr;
+    vk::DeviceSize _head {};
+    vk::DeviceSize _tail {};
+    // Bytes between the tail and the head, including the ones skipped when wrapping around
+    vk::DeviceSize _used {};
+
+    Batch _recording {};
+    std::deque<Batch> _inFlight {};
+    std::mutex _mutex;
+};
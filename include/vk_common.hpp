@@ -19,10 +19,22 @@ void VkCheckResult(VkResult result, std::string_view message);
 [[nodiscard]] ImageLayoutTransitionState VkGetImageLayoutTransitionDestinationState(vk::ImageLayout destinationLayout);
 void VkInitializeImageMemoryBarrier(vk::ImageMemoryBarrier2& barrier, vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t numLayers = 1, uint32_t mipLevel = 0, uint32_t mipCount = 1, vk::ImageAspectFlagBits imageAspect = vk::ImageAspectFlagBits::eColor);
 void VkTransitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, uint32_t numLayers = 1, uint32_t mipLevel = 0, uint32_t mipCount = 1, vk::ImageAspectFlagBits imageAspect = vk::ImageAspectFlagBits::eColor);
+// Barriers with explicit stages, for dependencies the layout based transitions above cannot express (e.g. ray tracing to compute)
+void VkGlobalMemoryBarrier(vk::CommandBuffer commandBuffer, const ImageLayoutTransitionState& sourceState, const ImageLayoutTransitionState& destinationState);
+void VkImageBarrier(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, const ImageLayoutTransitionState& sourceState, const ImageLayoutTransitionState& destinationState, uint32_t mipCount = 1);
 void VkCopyImageToImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, vk::Extent2D srcSize, vk::Extent2D dstSize);
-void VkCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
+void VkCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height, vk::DeviceSize bufferOffset = 0, uint32_t mipLevel = 0);
+void VkCopyImageToBuffer(vk::CommandBuffer commandBuffer, vk::Image image, vk::Buffer buffer, uint32_t width, uint32_t height);
 void VkCopyBufferToBuffer(vk::CommandBuffer commandBuffer, vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size, uint32_t offset = 0);
 VkTransformMatrixKHR VkGLMToTransformMatrixKHR(const glm::mat4& matrix);
+// Alignment has to be a power of two
+[[nodiscard]] vk::DeviceSize VkAlignUp(vk::DeviceSize value, vk::DeviceSize alignment);
+// Levels down to 1x1, halving the size each level
+[[nodiscard]] uint32_t VkMipLevelCount(uint32_t width, uint32_t height);
+// Size of a tightly packed mip level, as it's copied from a buffer
+[[nodiscard]] vk::DeviceSize VkMipLevelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t mipLevel);
+// Whether the format is stored in 4x4 blocks, which needs textureCompressionBC
+[[nodiscard]] bool VkIsBlockCompressed(vk::Format format);
 
 template <typename T>
 static void VkNameObject(T object, std::string_view name, const std::shared_ptr<VulkanContext>& context)
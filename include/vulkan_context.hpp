@@ -1,4 +1,5 @@
 #pragma once
+#include <array>
 #include <functional>
 #include <optional>
 #include <vk_mem_alloc.h>
@@ -11,6 +12,7 @@ struct VulkanInitInfo
     const char* const* extensions { nullptr };
     uint32_t width {}, height {};
 
+    // Leave empty to run headless, without a surface or present queue
     std::function<vk::SurfaceKHR(vk::Instance)> retrieveSurface;
 };
 
@@ -18,12 +20,25 @@ struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // Families without graphics support, which run next to the graphics queue, fall back to the graphics family
+    std::optional<uint32_t> computeFamily;
+    std::optional<uint32_t> transferFamily;
 
-   [[nodiscard]] bool IsComplete() const;
+    [[nodiscard]] bool IsComplete(bool requiresPresent = true) const;
 
     static QueueFamilyIndices FindQueueFamilies(vk::PhysicalDevice device, vk::SurfaceKHR surface);
 };
 
+enum class QueueType : uint8_t
+{
+    eGraphics,
+    // Acceleration structure builds, on a dedicated compute family when there is one
+    eCompute,
+    // Uploads, on a dedicated transfer family when there is one
+    eTransfer,
+    eCount
+};
+
 class VulkanContext
 {
 public:
@@ -35,14 +50,32 @@ public:
     [[nodiscard]] vk::detail::DispatchLoaderDynamic Dldi() const { return _dldi; }
     [[nodiscard]] vk::PhysicalDevice PhysicalDevice() const { return _physicalDevice; }
     [[nodiscard]] vk::Device Device() const { return _device; }
-    [[nodiscard]] vk::Queue GraphicsQueue() const { return _graphicsQueue; }
+    [[nodiscard]] vk::Queue GraphicsQueue() const { return Queue(QueueType::eGraphics); }
     [[nodiscard]] vk::Queue PresentQueue() const { return _presentQueue; }
     [[nodiscard]] vk::SurfaceKHR Surface() const { return _surface; }
-    [[nodiscard]] vk::CommandPool CommandPool() const { return _commandPool; }
+    // Queues of types that share a family are the same queue, so submissions to them are executed in order
+    [[nodiscard]] vk::Queue Queue(QueueType type) const { return _queues.at(static_cast<size_t>(type)); }
+    [[nodiscard]] vk::CommandPool CommandPool(QueueType type = QueueType::eGraphics) const { return _commandPools.at(static_cast<size_t>(type)); }
+    [[nodiscard]] uint32_t QueueFamily(QueueType type) const;
+    // Resources used by more than one queue type are shared concurrently between these, instead of transferring ownership
+    [[nodiscard]] const std::vector<uint32_t>& SharedQueueFamilies() const { return _sharedQueueFamilies; }
+    // Signalled by every submission to the queue type with the next value, so other queues can wait on their work
+    [[nodiscard]] vk::Semaphore Timeline(QueueType type) const { return _timelines.at(static_cast<size_t>(type)); }
+    // Last value a submission was made to signal
+    [[nodiscard]] uint64_t TimelineValue(QueueType type) const { return _timelineValues.at(static_cast<size_t>(type)); }
+    [[nodiscard]] uint64_t NextTimelineValue(QueueType type) { return ++_timelineValues.at(static_cast<size_t>(type)); }
     [[nodiscard]] VmaAllocator MemoryAllocator() const { return _vmaAllocator; }
     [[nodiscard]] const QueueFamilyIndices& QueueFamilies() const { return _queueFamilyIndices; }
+    [[nodiscard]] bool IsHeadless() const { return !_surface; }
+    // Acceleration structures can be built and copied on the CPU, with deferred operations
+    [[nodiscard]] bool SupportsHostAccelerationStructureCommands() const { return _hostAccelerationStructureCommands; }
+    // Textures can be sampled from BC1-BC7 block compressed formats
+    [[nodiscard]] bool SupportsTextureCompressionBC() const { return _textureCompressionBC; }
+    // Ray tracing launches can read their size from a buffer written on the GPU
+    [[nodiscard]] bool SupportsTraceRaysIndirect() const { return _traceRaysIndirect; }
 
     [[nodiscard]] vk::PhysicalDeviceRayTracingPipelinePropertiesKHR RayTracingPipelineProperties() const;
+    [[nodiscard]] vk::PhysicalDeviceAccelerationStructurePropertiesKHR AccelerationStructureProperties() const;
     [[nodiscard]] uint64_t GetBufferDeviceAddress(vk::Buffer buffer) const;
 
 private:
@@ -50,13 +83,19 @@ private:
     vk::detail::DispatchLoaderDynamic _dldi;
     vk::PhysicalDevice _physicalDevice;
     vk::Device _device;
-    vk::Queue _graphicsQueue;
     vk::Queue _presentQueue;
-    vk::CommandPool _commandPool;
+    std::array<vk::Queue, static_cast<size_t>(QueueType::eCount)> _queues;
+    std::array<vk::CommandPool, static_cast<size_t>(QueueType::eCount)> _commandPools;
+    std::array<vk::Semaphore, static_cast<size_t>(QueueType::eCount)> _timelines;
+    std::array<uint64_t, static_cast<size_t>(QueueType::eCount)> _timelineValues {};
     QueueFamilyIndices _queueFamilyIndices;
+    std::vector<uint32_t> _sharedQueueFamilies {};
     VmaAllocator _vmaAllocator;
 
     vk::SurfaceKHR _surface;
+    bool _hostAccelerationStructureCommands = false;
+    bool _textureCompressionBC = false;
+    bool _traceRaysIndirect = false;
 
     vk::DebugUtilsMessengerEXT _debugMessenger;
     bool _validationLayersEnabled = false;
@@ -66,7 +105,6 @@ private:
     };
 
     const std::vector<const char*> _deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
         VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
         VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
         VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
@@ -76,18 +114,19 @@ private:
         VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
         VK_KHR_MAINTENANCE3_EXTENSION_NAME,
         VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
-        VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME,
-        VK_KHR_SHADER_CLOCK_EXTENSION_NAME
+        VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME
     };
 
     void InitializeInstance(const VulkanInitInfo& initInfo);
     void InizializeValidationLayers();
     void InitializePhysicalDevice();
     void InitializeDevice();
-    void InitializeCommandPool();
+    void InitializeCommandPools();
+    void InitializeTimelines();
     void InitializeVMA();
     [[nodiscard]] bool AreValidationLayersSupported() const;
     [[nodiscard]] std::vector<const char*> GetRequiredInstanceExtensions(const VulkanInitInfo& initInfo) const;
+    [[nodiscard]] std::vector<const char*> GetRequiredDeviceExtensions() const;
     [[nodiscard]] uint32_t RateDeviceSuitability(const vk::PhysicalDevice& deviceToRate) const;
     [[nodiscard]] bool AreExtensionsSupported(const vk::PhysicalDevice& deviceToCheckSupport) const;
 };
@@ -0,0 +1,35 @@
+#ifndef ACCUMULATION_GLSL
+#define ACCUMULATION_GLSL
+
+#include "color.glsl"
+
+// Shared between ray_gen.rgen and resolve.comp, has to match the layouts in the renderer
+
+// Sum of the radiance of every launch, with the amount of launches for the pixel in alpha
+layout(set = 1, binding = 0, rgba32f) uniform image2D accumulationImage;
+// Sum of the squared luminance of every launch, to estimate the variance of the pixel
+layout(set = 1, binding = 4, r32f) uniform image2D momentImage;
+
+const uint ADAPTIVE_TILE_SIZE = 8;
+
+// Starts with a VkTraceRaysIndirectCommandKHR, the height of which is the amount of unconverged tiles
+layout(std430, set = 1, binding = 5) buffer AdaptiveTiles
+{
+    uint indirectWidth;
+    uint indirectHeight;
+    uint indirectDepth;
+    uint unconvergedPixels;
+    // Tile coordinates, packed as x | y << 16
+    uint tiles[];
+};
+
+layout(push_constant) uniform PushConstants
+{
+    int frame;
+    // When set, the launch traces the tiles in the tile list instead of the full image
+    uint adaptive;
+    float convergenceThreshold;
+    uint adaptiveMinFrames;
+};
+
+#endif // ACCUMULATION_GLSL
@@ -32,6 +32,8 @@ layout (std140, set = 0, binding = 1) uniform Materials
 
 struct GeometryNode
 {
+    // Transform of the geometry inside its BLAS, the instance transform is applied on top
+    mat4 transform;
     uint64_t vertexBufferDeviceAddress;
     uint64_t indexBufferDeviceAddress;
     uint materialIndex;
@@ -49,3 +51,21 @@ layout (set = 0, binding = 3) buffer BLASInstances
 {
     BLASInstance blasInstances[];
 };
+
+struct EmissiveTriangle
+{
+    vec3 p0;
+    float area;
+    vec3 p1;
+    float aliasThreshold;
+    vec3 p2;
+    uint alias;
+    vec3 emission;
+};
+layout (std430, set = 0, binding = 4) buffer EmissiveTriangles
+{
+    uint emissiveTriangleCount;
+    // Sum of the luminance of the emission times area over all triangles
+    float emissiveTotalPower;
+    EmissiveTriangle emissiveTriangles[];
+};
@@ -1,9 +1,16 @@
+#include "sampling.glsl"
+
 struct HitPayload
 {
     vec3 hitValue;
-    uint seed;
+    SamplerState samplerState;
     uint depth;
     vec3 rayOrigin;
     vec3 rayDirection;
     vec3 weight;
+    // Solid angle pdf of the direction that was sampled to arrive at this hit, used to weight emission against light sampling
+    float bsdfPdf;
+    // Ray cone that selects the texture LOD, its width grows with the spread angle over the length of the path
+    float coneWidth;
+    float coneSpreadAngle;
 };
@@ -1,46 +1,112 @@
-// Generate a random unsigned int from two unsigned int values, using 16 pairs
-// of rounds of the Tiny Encryption Algorithm. See Zafar, Olano, and Curtis,
-// "GPU Random Numbers via the Tiny Encryption Algorithm"
-uint TEA(uint val0, uint val1)
+#ifndef SAMPLING_GLSL
+#define SAMPLING_GLSL
+
+#define PI 3.14159265
+
+// Low bias 32-bit integer hash, from Chris Wellons' hash prospector
+uint Hash(uint x)
 {
-    uint v0 = val0;
-    uint v1 = val1;
-    uint s0 = 0;
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
 
-    for (uint n = 0; n < 16; ++n)
+uint HashCombine(uint seed, uint value)
+{
+    return seed ^ (Hash(value) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Hash based Owen scrambling, see Burley, "Practical Hash-based Owen Scrambling" (JCGT 2020)
+uint LaineKarrasPermutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+uint NestedUniformScramble(uint x, uint seed)
+{
+    x = bitfieldReverse(x);
+    x = LaineKarrasPermutation(x, seed);
+    x = bitfieldReverse(x);
+    return x;
+}
+
+// First two dimensions of the Sobol sequence, the first is the van der Corput sequence
+// and the second uses the direction numbers of the primitive polynomial x + 1
+uvec2 Sobol2D(uint index)
+{
+    uint y = 0;
+    uint direction = 0x80000000u;
+    for (uint bits = index; bits != 0; bits >>= 1)
     {
-        s0 += 0x9e3779b9;
-        v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
-        v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+        if ((bits & 1u) != 0)
+        {
+            y ^= direction;
+        }
+        direction ^= direction >> 1;
     }
 
-    return v0;
+    return uvec2(bitfieldReverse(index), y);
 }
 
-// Generate a random unsigned int in [0, 2^24) given the previous RNG state
-// using the Numerical Recipes linear congruential generator
-uint LCG(inout uint prev)
+float UintToUnitFloat(uint x)
 {
-    uint LCG_A = 1664525u;
-    uint LCG_C = 1013904223u;
-    prev = (LCG_A * prev + LCG_C);
-    return prev & 0x00FFFFFF;
+    return float(x >> 8) * (1.0 / 16777216.0);
 }
 
-// Generate a random float in [0, 1) given the previous RNG state
-float Random(inout uint prev)
+// Every path sample of a pixel gets an index into the sequence, the pixel decorrelates the scrambling
+struct SamplerState
 {
-    return (float(LCG(prev)) / float(0x01000000));
+    uint pixelSeed;
+    uint sampleIndex;
+};
+
+SamplerState InitializeSampler(uvec2 pixel, uint sampleIndex)
+{
+    SamplerState state;
+    state.pixelSeed = Hash(pixel.x ^ Hash(pixel.y));
+    state.sampleIndex = sampleIndex;
+    return state;
 }
 
-// Randomly samples from a cosine-weighted hemisphere oriented in the `z` direction.
-// From Ray Tracing Gems section 16.6.1, "Cosine-Weighted Hemisphere Oriented to the Z-Axis"
-vec3 SamplingHemisphere(inout uint seed, vec3 x, vec3 y, vec3 z)
+// Owen scrambled 2D Sobol point in [0, 1)^2. Higher dimensions are padded by giving every pair of
+// dimensions its own shuffle of the sample index and its own scramble, which keeps each pair well stratified
+vec2 Sample2D(SamplerState state, uint dimensionPair)
+{
+    const uint seed = HashCombine(state.pixelSeed, dimensionPair);
+    const uint shuffledIndex = NestedUniformScramble(state.sampleIndex, seed);
+    const uvec2 sobol = Sobol2D(shuffledIndex);
+
+    return vec2(UintToUnitFloat(NestedUniformScramble(sobol.x, HashCombine(seed, 0u))),
+                UintToUnitFloat(NestedUniformScramble(sobol.y, HashCombine(seed, 1u))));
+}
+
+// Fixed dimension layout, so the same decision at the same depth always uses the same dimensions
+const uint DIMENSION_CAMERA = 0;
+const uint DIMENSION_BSDF = 0;
+const uint DIMENSION_LIGHT_SELECTION = 1;
+const uint DIMENSION_LIGHT_POINT = 2;
+const uint DIMENSION_ROULETTE = 3;
+const uint DIMENSIONS_PER_BOUNCE = 4;
+
+uint BounceDimension(uint depth, uint dimension)
 {
-    #define PI 3.14159265
+    return 1 + depth * DIMENSIONS_PER_BOUNCE + dimension;
+}
 
-    float r1 = Random(seed);
-    float r2 = Random(seed);
+// Samples from a cosine-weighted hemisphere oriented in the `z` direction.
+// From Ray Tracing Gems section 16.6.1, "Cosine-Weighted Hemisphere Oriented to the Z-Axis"
+vec3 SamplingHemisphere(vec2 u, vec3 x, vec3 y, vec3 z)
+{
+    float r1 = u.x;
+    float r2 = u.y;
     float sq = sqrt(r1);
 
     vec3 direction = vec3(cos(2 * PI * r2) * sq, sin(2 * PI * r2) * sq, sqrt(1. - r1));
@@ -63,3 +129,5 @@ void CreateCoordinateSystem(in vec3 N, out vec3 Nt, out vec3 Nb)
 
     Nb = cross(N, Nt);
 }
+
+#endif // SAMPLING_GLSL
@@ -0,0 +1,146 @@
+#include "acceleration_structure_arena.hpp"
+#include "resources/gpu_resources.hpp"
+#include "vk_common.hpp"
+#include "vulkan_context.hpp"
+#include <spdlog/spdlog.h>
+
+AccelerationStructureAllocation::~AccelerationStructureAllocation()
+{
+    if (_arena)
+    {
+        _arena->Free(*this);
+    }
+}
+
+AccelerationStructureAllocation::AccelerationStructureAllocation(AccelerationStructureAllocation&& other) noexcept
+    : buffer(other.buffer)
+    , offset(other.offset)
+    , size(other.size)
+    , _arena(other._arena)
+    , _blockIndex(other._blockIndex)
+    , _allocation(other._allocation)
+{
+    other._arena = nullptr;
+}
+
+AccelerationStructureAllocation& AccelerationStructureAllocation::operator=(AccelerationStructureAllocation&& other) noexcept
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    if (_arena)
+    {
+        _arena->Free(*this);
+    }
+
+    buffer = other.buffer;
+    offset = other.offset;
+    size = other.size;
+    _arena = other._arena;
+    _blockIndex = other._blockIndex;
+    _allocation = other._allocation;
+
+    other._arena = nullptr;
+    return *this;
+}
+
+AccelerationStructureArena::AccelerationStructureArena(bool hostVisible, const std::shared_ptr<VulkanContext>& vulkanContext)
+    : _hostVisible(hostVisible)
+    , _vulkanContext(vulkanContext)
+{
+}
+
+AccelerationStructureArena::~AccelerationStructureArena()
+{
+    for (auto& block : _blocks)
+    {
+        if (block.virtualBlock)
+        {
+            // Structures still alive at this point are leaked by their owner, their ranges go with the block
+            vmaClearVirtualBlock(block.virtualBlock);
+            vmaDestroyVirtualBlock(block.virtualBlock);
+        }
+    }
+}
+
+AccelerationStructureAllocation AccelerationStructureArena::Allocate(vk::DeviceSize size)
+{
+    VmaVirtualAllocationCreateInfo allocationCreateInfo {};
+    allocationCreateInfo.size = size;
+    allocationCreateInfo.alignment = STRUCTURE_ALIGNMENT;
+
+    AccelerationStructureAllocation allocation {};
+    allocation.size = size;
+
+    const auto AssignBlock = [&](uint32_t blockIndex)
+    {
+        allocation.buffer = _blocks[blockIndex].buffer->buffer;
+        allocation._arena = this;
+        allocation._blockIndex = blockIndex;
+    };
+
+    for (uint32_t i = 0; i < _blocks.size(); ++i)
+    {
+        if (_blocks[i].virtualBlock && vmaVirtualAllocate(_blocks[i].virtualBlock, &allocationCreateInfo, &allocation._allocation, &allocation.offset) == VK_SUCCESS)
+        {
+            AssignBlock(i);
+            return allocation;
+        }
+    }
+
+    // Reuses the slot of a released block when there is one
+    uint32_t blockIndex = static_cast<uint32_t>(_blocks.size());
+    for (uint32_t i = 0; i < _blocks.size(); ++i)
+    {
+        if (!_blocks[i].virtualBlock)
+        {
+            blockIndex = i;
+            break;
+        }
+    }
+    if (blockIndex == _blocks.size())
+    {
+        _blocks.emplace_back();
+    }
+
+    CreateBlock(_blocks[blockIndex], std::max(BLOCK_SIZE, VkAlignUp(size, STRUCTURE_ALIGNMENT)));
+    VkCheckResult(vmaVirtualAllocate(_blocks[blockIndex].virtualBlock, &allocationCreateInfo, &allocation._allocation, &allocation.offset),
+        "[VULKAN] Failed allocating acceleration structure memory!");
+    AssignBlock(blockIndex);
+
+    return allocation;
+}
+
+void AccelerationStructureArena::Free(AccelerationStructureAllocation& allocation)
+{
+    Block& block = _blocks[allocation._blockIndex];
+    vmaVirtualFree(block.virtualBlock, allocation._allocation);
+    allocation._arena = nullptr;
+
+    if (vmaIsVirtualBlockEmpty(block.virtualBlock))
+    {
+        vmaDestroyVirtualBlock(block.virtualBlock);
+        block.virtualBlock = nullptr;
+        block.buffer.reset();
+    }
+}
+
+void AccelerationStructureArena::CreateBlock(Block& block, vk::DeviceSize size)
+{
+    // The CPU writes the structures directly for host builds, so they need memory it can access
+    BufferCreation blockBufferCreation {};
+    blockBufferCreation.SetName("Acceleration Structure Arena Block")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        .SetMemoryUsage(_hostVisible ? VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE : VMA_MEMORY_USAGE_GPU_ONLY)
+        .SetIsMappable(_hostVisible)
+        .SetSize(size);
+    block.buffer = std::make_unique<Buffer>(blockBufferCreation, _vulkanContext);
+
+    VmaVirtualBlockCreateInfo virtualBlockCreateInfo {};
+    virtualBlockCreateInfo.size = size;
+    VkCheckResult(vmaCreateVirtualBlock(&virtualBlockCreateInfo, &block.virtualBlock), "[VULKAN] Failed creating acceleration structure arena block!");
+
+    spdlog::info("[RENDERER] Allocated acceleration structure arena block of {} MiB", size / (1024 * 1024));
+}
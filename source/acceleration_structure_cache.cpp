@@ -0,0 +1,326 @@
+#include "acceleration_structure_cache.hpp"
+#include "bottom_level_acceleration_structure.hpp"
+#include "resources/gpu_resources.hpp"
+#include "single_time_commands.hpp"
+#include "vk_common.hpp"
+#include "vulkan_context.hpp"
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+// Serialized data starts with the driver UUID and compatibility UUID, followed by the serialized size,
+// the deserialized size and the amount of handles to other structures
+constexpr size_t SERIALIZED_HEADER_SIZE = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+
+uint64_t SerializedHeaderField(const std::vector<std::byte>& data, size_t index)
+{
+    uint64_t value {};
+    std::memcpy(&value, data.data() + 2 * VK_UUID_SIZE + index * sizeof(uint64_t), sizeof(uint64_t));
+    return value;
+}
+
+AccelerationStructureCache::AccelerationStructureCache(const std::filesystem::path& directory, const std::shared_ptr<VulkanContext>& vulkanContext)
+    : _directory(directory)
+    , _vulkanContext(vulkanContext)
+{
+}
+
+std::vector<bool> AccelerationStructureCache::Restore(const std::vector<BottomLevelAccelerationStructure*>& structures, const std::vector<uint64_t>& keys)
+{
+    std::vector<bool> restored(structures.size(), false);
+
+    std::vector<std::optional<std::vector<std::byte>>> entries(structures.size());
+    size_t entryCount = 0;
+    for (size_t i = 0; i < structures.size(); ++i)
+    {
+        entries[i] = ReadEntry(keys[i]);
+        entryCount += entries[i].has_value();
+    }
+
+    if (entryCount == 0)
+    {
+        return restored;
+    }
+
+    const bool hostBuild = structures.front()->BuildType() == vk::AccelerationStructureBuildTypeKHR::eHost;
+    std::vector<RetiredAccelerationStructure> originals {};
+    originals.reserve(entryCount);
+
+    if (hostBuild)
+    {
+        for (size_t i = 0; i < structures.size(); ++i)
+        {
+            if (!entries[i].has_value())
+            {
+                continue;
+            }
+
+            vk::DeviceOrHostAddressConstKHR data {};
+            data.hostAddress = entries[i]->data();
+            originals.push_back(structures[i]->Deserialize(nullptr, data, SerializedHeaderField(*entries[i], 1)));
+            restored[i] = true;
+        }
+    }
+    else
+    {
+        // All entries are uploaded at once, at offsets that meet the alignment of the copies
+        std::vector<vk::DeviceSize> offsets(structures.size());
+        vk::DeviceSize uploadSize = 0;
+        for (size_t i = 0; i < structures.size(); ++i)
+        {
+            if (entries[i].has_value())
+            {
+                offsets[i] = uploadSize;
+                uploadSize += VkAlignUp(entries[i]->size(), SERIALIZED_DATA_ALIGNMENT);
+            }
+        }
+
+        BufferCreation uploadBufferCreation {};
+        uploadBufferCreation.SetName("Serialized BLAS Upload Buffer")
+            .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
+            .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_TO_GPU)
+            .SetIsMappable(true)
+            .SetSize(uploadSize + SERIALIZED_DATA_ALIGNMENT);
+        Buffer uploadBuffer(uploadBufferCreation, _vulkanContext);
+
+        const vk::DeviceAddress bufferAddress = _vulkanContext->GetBufferDeviceAddress(uploadBuffer.buffer);
+        const vk::DeviceAddress uploadAddress = VkAlignUp(bufferAddress, SERIALIZED_DATA_ALIGNMENT);
+        std::byte* uploadData = static_cast<std::byte*>(uploadBuffer.mappedPtr) + (uploadAddress - bufferAddress);
+
+        for (size_t i = 0; i < structures.size(); ++i)
+        {
+            if (entries[i].has_value())
+            {
+                std::memcpy(uploadData + offsets[i], entries[i]->data(), entries[i]->size());
+            }
+        }
+        VkCheckResult(vmaFlushAllocation(_vulkanContext->MemoryAllocator(), uploadBuffer.allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed flushing serialized BLAS upload buffer!");
+
+        SingleTimeCommands commands(_vulkanContext, QueueType::eCompute);
+        commands.Record([&](vk::CommandBuffer commandBuffer)
+            {
+                for (size_t i = 0; i < structures.size(); ++i)
+                {
+                    if (!entries[i].has_value())
+                    {
+                        continue;
+                    }
+
+                    vk::DeviceOrHostAddressConstKHR data {};
+                    data.deviceAddress = uploadAddress + offsets[i];
+                    originals.push_back(structures[i]->Deserialize(commandBuffer, data, SerializedHeaderField(*entries[i], 1)));
+                    restored[i] = true;
+                } });
+        commands.SubmitAndWait();
+    }
+
+    for (const auto& original : originals)
+    {
+        _vulkanContext->Device().destroyAccelerationStructureKHR(original.structure, nullptr, _vulkanContext->Dldi());
+    }
+
+    spdlog::info("[RENDERER] Restored {} of {} bottom level acceleration structures from the cache", entryCount, structures.size());
+    return restored;
+}
+
+void AccelerationStructureCache::Store(const std::vector<BottomLevelAccelerationStructure*>& structures, const std::vector<uint64_t>& keys)
+{
+    if (structures.empty())
+    {
+        return;
+    }
+
+    const bool hostBuild = structures.front()->BuildType() == vk::AccelerationStructureBuildTypeKHR::eHost;
+    const std::vector<std::vector<std::byte>> serialized = hostBuild ? SerializeOnHost(structures) : SerializeOnDevice(structures);
+
+    size_t totalSize = 0;
+    for (size_t i = 0; i < structures.size(); ++i)
+    {
+        WriteEntry(keys[i], serialized[i]);
+        totalSize += serialized[i].size();
+    }
+
+    spdlog::info("[RENDERER] Stored {} bottom level acceleration structures in the cache, {} KiB", structures.size(), totalSize / 1024);
+}
+
+std::filesystem::path AccelerationStructureCache::EntryPath(uint64_t key) const
+{
+    return _directory / fmt::format("{:016x}.blas", key);
+}
+
+std::optional<std::vector<std::byte>> AccelerationStructureCache::ReadEntry(uint64_t key) const
+{
+    const std::filesystem::path path = EntryPath(key);
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+    {
+        return std::nullopt;
+    }
+
+    const std::streamsize size = file.tellg();
+    if (size < static_cast<std::streamsize>(SERIALIZED_HEADER_SIZE))
+    {
+        spdlog::warn("[FILE] Ignoring truncated acceleration structure cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    std::vector<std::byte> data(size);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(data.data()), size) || SerializedHeaderField(data, 0) != data.size())
+    {
+        spdlog::warn("[FILE] Ignoring truncated acceleration structure cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    // Checks the UUIDs at the start of the data against the current driver and device
+    vk::AccelerationStructureVersionInfoKHR versionInfo {};
+    versionInfo.pVersionData = reinterpret_cast<const uint8_t*>(data.data());
+    if (_vulkanContext->Device().getAccelerationStructureCompatibilityKHR(versionInfo, _vulkanContext->Dldi()) != vk::AccelerationStructureCompatibilityKHR::eCompatible)
+    {
+        spdlog::info("[FILE] Acceleration structure cache entry was written by an incompatible driver or device: {}", path.string());
+        return std::nullopt;
+    }
+
+    return data;
+}
+
+void AccelerationStructureCache::WriteEntry(uint64_t key, const std::vector<std::byte>& data) const
+{
+    std::error_code error {};
+    std::filesystem::create_directories(_directory, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed creating acceleration structure cache directory {}: {}", _directory.string(), error.message());
+        return;
+    }
+
+    // Written next to the entry and moved in place, so an interrupted write never leaves a truncated entry behind
+    const std::filesystem::path path = EntryPath(key);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size())))
+        {
+            spdlog::warn("[FILE] Failed writing acceleration structure cache entry: {}", temporaryPath.string());
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed writing acceleration structure cache entry {}: {}", path.string(), error.message());
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+std::vector<std::vector<std::byte>> AccelerationStructureCache::SerializeOnDevice(const std::vector<BottomLevelAccelerationStructure*>& structures) const
+{
+    std::vector<vk::AccelerationStructureKHR> vkStructures {};
+    vkStructures.reserve(structures.size());
+    for (const auto* blas : structures)
+    {
+        vkStructures.push_back(blas->Structure());
+    }
+
+    const uint32_t queryCount = static_cast<uint32_t>(vkStructures.size());
+    vk::QueryPoolCreateInfo queryPoolCreateInfo {};
+    queryPoolCreateInfo.queryType = vk::QueryType::eAccelerationStructureSerializationSizeKHR;
+    queryPoolCreateInfo.queryCount = queryCount;
+    const vk::QueryPool queryPool = _vulkanContext->Device().createQueryPool(queryPoolCreateInfo);
+
+    {
+        SingleTimeCommands commands(_vulkanContext, QueueType::eCompute);
+        commands.Record([&](vk::CommandBuffer commandBuffer)
+            {
+                commandBuffer.resetQueryPool(queryPool, 0, queryCount);
+                commandBuffer.writeAccelerationStructuresPropertiesKHR(vkStructures, vk::QueryType::eAccelerationStructureSerializationSizeKHR, queryPool, 0, _vulkanContext->Dldi()); });
+        commands.SubmitAndWait();
+    }
+
+    std::vector<vk::DeviceSize> serializedSizes(queryCount);
+    VkCheckResult(_vulkanContext->Device().getQueryPoolResults(queryPool, 0, queryCount, serializedSizes.size() * sizeof(vk::DeviceSize), serializedSizes.data(),
+                      sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait),
+        "[VULKAN] Failed reading serialized acceleration structure sizes!");
+    _vulkanContext->Device().destroyQueryPool(queryPool);
+
+    std::vector<vk::DeviceSize> offsets(structures.size());
+    vk::DeviceSize readbackSize = 0;
+    for (size_t i = 0; i < structures.size(); ++i)
+    {
+        offsets[i] = readbackSize;
+        readbackSize += VkAlignUp(serializedSizes[i], SERIALIZED_DATA_ALIGNMENT);
+    }
+
+    BufferCreation readbackBufferCreation {};
+    readbackBufferCreation.SetName("Serialized BLAS Readback Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_TO_CPU)
+        .SetIsMappable(true)
+        .SetSize(readbackSize + SERIALIZED_DATA_ALIGNMENT);
+    Buffer readbackBuffer(readbackBufferCreation, _vulkanContext);
+
+    const vk::DeviceAddress bufferAddress = _vulkanContext->GetBufferDeviceAddress(readbackBuffer.buffer);
+    const vk::DeviceAddress readbackAddress = VkAlignUp(bufferAddress, SERIALIZED_DATA_ALIGNMENT);
+
+    SingleTimeCommands commands(_vulkanContext, QueueType::eCompute);
+    commands.Record([&](vk::CommandBuffer commandBuffer)
+        {
+            for (size_t i = 0; i < structures.size(); ++i)
+            {
+                vk::CopyAccelerationStructureToMemoryInfoKHR copyInfo {};
+                copyInfo.src = vkStructures[i];
+                copyInfo.dst.deviceAddress = readbackAddress + offsets[i];
+                copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eSerialize;
+                commandBuffer.copyAccelerationStructureToMemoryKHR(copyInfo, _vulkanContext->Dldi());
+            }
+
+            // Without VK_KHR_ray_tracing_maintenance1 copies to memory are synchronized as acceleration structure builds
+            VkGlobalMemoryBarrier(commandBuffer,
+                { vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR, vk::AccessFlagBits2::eAccelerationStructureWriteKHR },
+                { vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostRead }); });
+    commands.SubmitAndWait();
+
+    VkCheckResult(vmaInvalidateAllocation(_vulkanContext->MemoryAllocator(), readbackBuffer.allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed invalidating serialized BLAS readback buffer!");
+
+    const std::byte* readbackData = static_cast<const std::byte*>(readbackBuffer.mappedPtr) + (readbackAddress - bufferAddress);
+    std::vector<std::vector<std::byte>> serialized(structures.size());
+    for (size_t i = 0; i < structures.size(); ++i)
+    {
+        serialized[i].assign(readbackData + offsets[i], readbackData + offsets[i] + serializedSizes[i]);
+    }
+
+    return serialized;
+}
+
+std::vector<std::vector<std::byte>> AccelerationStructureCache::SerializeOnHost(const std::vector<BottomLevelAccelerationStructure*>& structures) const
+{
+    std::vector<vk::AccelerationStructureKHR> vkStructures {};
+    vkStructures.reserve(structures.size());
+    for (const auto* blas : structures)
+    {
+        vkStructures.push_back(blas->Structure());
+    }
+
+    std::vector<vk::DeviceSize> serializedSizes(vkStructures.size());
+    VkCheckResult(_vulkanContext->Device().writeAccelerationStructuresPropertiesKHR(static_cast<uint32_t>(vkStructures.size()), vkStructures.data(), vk::QueryType::eAccelerationStructureSerializationSizeKHR,
+                      serializedSizes.size() * sizeof(vk::DeviceSize), serializedSizes.data(), sizeof(vk::DeviceSize), _vulkanContext->Dldi()),
+        "[VULKAN] Failed reading serialized acceleration structure sizes!");
+
+    std::vector<std::vector<std::byte>> serialized(structures.size());
+    for (size_t i = 0; i < structures.size(); ++i)
+    {
+        serialized[i].resize(serializedSizes[i]);
+
+        vk::CopyAccelerationStructureToMemoryInfoKHR copyInfo {};
+        copyInfo.src = vkStructures[i];
+        copyInfo.dst.hostAddress = serialized[i].data();
+        copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eSerialize;
+        VkCheckResult(_vulkanContext->Device().copyAccelerationStructureToMemoryKHR(nullptr, copyInfo, _vulkanContext->Dldi()), "[VULKAN] Failed serializing acceleration structure on the host!");
+    }
+
+    return serialized;
+}
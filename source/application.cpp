@@ -8,9 +8,184 @@
 #include "vulkan_context.hpp"
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
+#include <charconv>
 #include <spdlog/spdlog.h>
+#include <string_view>
 
-Application::Application()
+ApplicationSettings ApplicationSettings::FromArguments(int argc, char* argv[])
+{
+    ApplicationSettings settings {};
+    bool sceneOverridden = false;
+
+    // Malformed numbers leave the setting untouched, instead of throwing like std::stoul and std::stof
+    const auto ParseNumber = [](std::string_view value, auto& out)
+    {
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), out);
+        return error == std::errc {} && end == value.data() + value.size();
+    };
+
+    for (int32_t i = 1; i < argc; ++i)
+    {
+        const std::string_view argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (argument == "--headless")
+        {
+            settings.headless = true;
+        }
+        else if (argument == "--width" && hasValue)
+        {
+            uint32_t width {};
+            if (ParseNumber(argv[++i], width) && width > 0)
+            {
+                settings.width = width;
+            }
+            else
+            {
+                spdlog::warn("[APPLICATION] Invalid width \"{}\", expected a positive whole number", argv[i]);
+            }
+        }
+        else if (argument == "--height" && hasValue)
+        {
+            uint32_t height {};
+            if (ParseNumber(argv[++i], height) && height > 0)
+            {
+                settings.height = height;
+            }
+            else
+            {
+                spdlog::warn("[APPLICATION] Invalid height \"{}\", expected a positive whole number", argv[i]);
+            }
+        }
+        else if (argument == "--samples" && hasValue)
+        {
+            uint32_t samples {};
+            if (ParseNumber(argv[++i], samples) && samples > 0)
+            {
+                settings.sampleBudget = samples;
+            }
+            else
+            {
+                spdlog::warn("[APPLICATION] Invalid sample count \"{}\", expected a positive whole number", argv[i]);
+            }
+        }
+        else if (argument == "--quality" && hasValue)
+        {
+            settings.quality = ParseRenderQuality(argv[++i]);
+            if (!settings.quality)
+            {
+                spdlog::warn("[APPLICATION] Unknown quality \"{}\", expected preview, production or reference", argv[i]);
+            }
+        }
+        else if (argument == "--convergence" && hasValue)
+        {
+            float threshold {};
+            if (ParseNumber(argv[++i], threshold) && threshold >= 0.0f)
+            {
+                settings.convergenceThreshold = threshold;
+            }
+            else
+            {
+                spdlog::warn("[APPLICATION] Invalid convergence threshold \"{}\", expected a number of at least 0", argv[i]);
+            }
+        }
+        else if (argument == "--blas-granularity" && hasValue)
+        {
+            settings.blasGranularity = ParseBLASGranularity(argv[++i]);
+            if (!settings.blasGranularity)
+            {
+                spdlog::warn("[APPLICATION] Unknown BLAS granularity \"{}\", expected mesh, node or model", argv[i]);
+            }
+        }
+        else if (argument == "--blas-cache" && hasValue)
+        {
+            const std::string_view directory = argv[++i];
+            settings.blasCacheDirectory = directory == "none" ? std::string {} : std::string { directory };
+        }
+        else if (argument == "--texture-cache" && hasValue)
+        {
+            const std::string_view directory = argv[++i];
+            settings.textureCacheDirectory = directory == "none" ? std::string {} : std::string { directory };
+        }
+        else if (argument == "--scene-cache" && hasValue)
+        {
+            const std::string_view directory = argv[++i];
+            settings.sceneCacheDirectory = directory == "none" ? std::string {} : std::string { directory };
+        }
+        else if (argument == "--output" && hasValue)
+        {
+            settings.outputPath = argv[++i];
+        }
+        else if (argument == "--batch" && hasValue)
+        {
+            settings.batchManifestPath = argv[++i];
+        }
+        else if (argument == "--scene" && hasValue)
+        {
+            if (!sceneOverridden)
+            {
+                settings.scene.clear();
+                sceneOverridden = true;
+            }
+            settings.scene.emplace_back(argv[++i]);
+        }
+        else
+        {
+            spdlog::warn("[APPLICATION] Ignoring unknown or incomplete argument: {}", argument);
+        }
+    }
+
+    return settings;
+}
+
+Application::Application(const ApplicationSettings& settings)
+    : _settings(settings)
+{
+    if (_settings.headless)
+    {
+        InitializeHeadless();
+    }
+    else
+    {
+        InitializeWindowed();
+    }
+}
+
+Application::~Application()
+{
+    if (_settings.headless)
+    {
+        return;
+    }
+
+    SDL_DestroyWindow(_window);
+    SDL_Quit();
+}
+
+int Application::Run()
+{
+    // Also covers initialization failing before the scene was loaded
+    if (!_sceneLoaded)
+    {
+        spdlog::error("[APPLICATION] Failed loading the scene, exiting");
+        return 1;
+    }
+
+    if (_settings.headless)
+    {
+        _renderer->RenderOffscreen(_settings.sampleBudget);
+        return _renderer->SaveRenderTarget(_settings.outputPath) ? 0 : 1;
+    }
+
+    while (!_exitRequested)
+    {
+        MainLoopOnce();
+    }
+
+    return 0;
+}
+
+void Application::InitializeWindowed()
 {
     if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD))
     {
@@ -56,22 +231,49 @@ Application::Application()
 
     _vulkanContext = std::make_shared<VulkanContext>(vulkanInfo);
     _renderer = std::make_unique<Renderer>(vulkanInfo, _vulkanContext);
+    _renderer->SetQuality(_settings.quality.value_or(RenderQuality::ePreview));
+    _renderer->SetConvergenceThreshold(_settings.convergenceThreshold);
+    _renderer->SetBLASGranularity(_settings.blasGranularity.value_or(BLASGranularity::eMesh));
+    if (_settings.blasCacheDirectory)
+    {
+        _renderer->SetBLASCacheDirectory(_settings.blasCacheDirectory.value());
+    }
+    if (_settings.textureCacheDirectory)
+    {
+        _renderer->SetTextureCacheDirectory(_settings.textureCacheDirectory.value());
+    }
+    if (_settings.sceneCacheDirectory)
+    {
+        _renderer->SetSceneCacheDirectory(_settings.sceneCacheDirectory.value());
+    }
+    _sceneLoaded = _renderer->LoadScene(_settings.scene);
 }
 
-Application::~Application()
+void Application::InitializeHeadless()
 {
-    SDL_DestroyWindow(_window);
-    SDL_Quit();
-}
+    // No window, surface or instance extensions are needed when rendering offscreen
+    VulkanInitInfo vulkanInfo {};
+    vulkanInfo.width = _settings.width;
+    vulkanInfo.height = _settings.height;
 
-int Application::Run()
-{
-    while (!_exitRequested)
+    _vulkanContext = std::make_shared<VulkanContext>(vulkanInfo);
+    _renderer = std::make_unique<Renderer>(vulkanInfo, _vulkanContext);
+    _renderer->SetQuality(_settings.quality.value_or(RenderQuality::eProduction));
+    _renderer->SetConvergenceThreshold(_settings.convergenceThreshold);
+    _renderer->SetBLASGranularity(_settings.blasGranularity.value_or(BLASGranularity::eMesh));
+    if (_settings.blasCacheDirectory)
     {
-        MainLoopOnce();
+        _renderer->SetBLASCacheDirectory(_settings.blasCacheDirectory.value());
     }
-
-    return 0;
+    if (_settings.textureCacheDirectory)
+    {
+        _renderer->SetTextureCacheDirectory(_settings.textureCacheDirectory.value());
+    }
+    if (_settings.sceneCacheDirectory)
+    {
+        _renderer->SetSceneCacheDirectory(_settings.sceneCacheDirectory.value());
+    }
+    _sceneLoaded = _renderer->LoadScene(_settings.scene);
 }
 
 void Application::MainLoopOnce()
@@ -0,0 +1,194 @@
+#include "batch_runner.hpp"
+#include "renderer.hpp"
+#include "vulkan_context.hpp"
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <sstream>
+
+bool ParseVec3(std::string_view value, glm::vec3& out)
+{
+    std::istringstream stream { std::string { value } };
+    char separator {};
+    stream >> out.x >> separator >> out.y >> separator >> out.z;
+    return !stream.fail();
+}
+
+// Fails on anything but a plain number, instead of throwing like std::stoul and std::stof
+template <typename T>
+bool ParseNumber(std::string_view value, T& out)
+{
+    const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), out);
+    return error == std::errc {} && end == value.data() + value.size();
+}
+
+bool ParseResolution(std::string_view value, uint32_t& width, uint32_t& height)
+{
+    std::istringstream stream { std::string { value } };
+    char separator {};
+    stream >> width >> separator >> height;
+    return !stream.fail() && width > 0 && height > 0;
+}
+
+BatchRunner::BatchRunner(std::string_view manifestPath)
+    : _jobs(ParseManifest(manifestPath))
+{
+    if (_jobs.empty())
+    {
+        return;
+    }
+
+    VulkanInitInfo vulkanInfo {};
+    vulkanInfo.width = _jobs.front().width;
+    vulkanInfo.height = _jobs.front().height;
+
+    _vulkanContext = std::make_shared<VulkanContext>(vulkanInfo);
+    _renderer = std::make_unique<Renderer>(vulkanInfo, _vulkanContext);
+}
+
+BatchRunner::~BatchRunner() = default;
+
+int BatchRunner::Run()
+{
+    if (_jobs.empty())
+    {
+        spdlog::error("[BATCH] No render jobs to run");
+        return 1;
+    }
+
+    uint32_t failedJobs = 0;
+    for (size_t i = 0; i < _jobs.size(); ++i)
+    {
+        spdlog::info("[BATCH] Running job {}/{}: {}", i + 1, _jobs.size(), _jobs[i].outputPath);
+
+        const auto start = std::chrono::steady_clock::now();
+        if (!RunJob(_jobs[i]))
+        {
+            spdlog::error("[BATCH] Job {} failed", i + 1);
+            failedJobs++;
+            continue;
+        }
+
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        spdlog::info("[BATCH] Finished job {} in {:.2f}s", i + 1, duration.count());
+    }
+
+    spdlog::info("[BATCH] Completed {}/{} jobs", _jobs.size() - failedJobs, _jobs.size());
+    return failedJobs == 0 ? 0 : 1;
+}
+
+bool BatchRunner::RunJob(const RenderJob& job)
+{
+    _renderer->Resize(job.width, job.height);
+
+    if (!_renderer->LoadScene(job.scene))
+    {
+        return false;
+    }
+
+    _renderer->SetCamera(job.cameraPosition, job.cameraTarget);
+    _renderer->SetQuality(job.quality.value_or(RenderQuality::eProduction));
+    _renderer->SetConvergenceThreshold(job.convergenceThreshold);
+    _renderer->RenderOffscreen(job.sampleBudget);
+    return _renderer->SaveRenderTarget(job.outputPath);
+}
+
+std::vector<RenderJob> BatchRunner::ParseManifest(std::string_view manifestPath)
+{
+    std::ifstream file { std::string { manifestPath } };
+    if (!file.is_open())
+    {
+        spdlog::error("[FILE] Failed to open batch manifest {}", manifestPath);
+        return {};
+    }
+
+    std::vector<RenderJob> jobs {};
+    std::string line {};
+    uint32_t lineNumber = 0;
+
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+
+        std::istringstream lineStream { line };
+        std::string token {};
+        RenderJob job {};
+        bool valid = true;
+        bool empty = true;
+
+        while (lineStream >> token)
+        {
+            if (token.front() == '#')
+            {
+                break;
+            }
+            empty = false;
+
+            const size_t separator = token.find('=');
+            if (separator == std::string::npos)
+            {
+                spdlog::error("[BATCH] Expected key=value at line {}: {}", lineNumber, token);
+                valid = false;
+                continue;
+            }
+
+            const std::string_view key = std::string_view { token }.substr(0, separator);
+            const std::string_view value = std::string_view { token }.substr(separator + 1);
+
+            if (key == "scene")
+            {
+                job.scene.emplace_back(value);
+            }
+            else if (key == "camera")
+            {
+                valid &= ParseVec3(value, job.cameraPosition);
+            }
+            else if (key == "target")
+            {
+                valid &= ParseVec3(value, job.cameraTarget);
+            }
+            else if (key == "resolution")
+            {
+                valid &= ParseResolution(value, job.width, job.height);
+            }
+            else if (key == "samples")
+            {
+                valid &= ParseNumber(value, job.sampleBudget) && job.sampleBudget > 0;
+            }
+            else if (key == "quality")
+            {
+                job.quality = ParseRenderQuality(value);
+                valid &= job.quality.has_value();
+            }
+            else if (key == "convergence")
+            {
+                valid &= ParseNumber(value, job.convergenceThreshold) && job.convergenceThreshold >= 0.0f;
+            }
+            else if (key == "output")
+            {
+                job.outputPath = value;
+            }
+            else
+            {
+                spdlog::warn("[BATCH] Ignoring unknown key \"{}\" at line {}", key, lineNumber);
+            }
+        }
+
+        if (empty)
+        {
+            continue;
+        }
+
+        if (!valid || job.scene.empty() || job.outputPath.empty())
+        {
+            spdlog::error("[BATCH] Skipping invalid job at line {}, a job needs at least a scene and an output", lineNumber);
+            continue;
+        }
+
+        jobs.push_back(job);
+    }
+
+    spdlog::info("[BATCH] Parsed {} jobs from {}", jobs.size(), manifestPath);
+    return jobs;
+}
@@ -0,0 +1,343 @@
+#include "blas_builder.hpp"
+#include "acceleration_structure_arena.hpp"
+#include "acceleration_structure_cache.hpp"
+#include "bottom_level_acceleration_structure.hpp"
+#include "hash.hpp"
+#include "resources/gpu_resources.hpp"
+#include "single_time_commands.hpp"
+#include "thread_pool.hpp"
+#include "vk_common.hpp"
+#include "vulkan_context.hpp"
+#include <spdlog/spdlog.h>
+#include <thread>
+
+BLASBuilder::BLASBuilder(const std::shared_ptr<VulkanContext>& vulkanContext, const std::shared_ptr<ThreadPool>& threadPool, const std::shared_ptr<AccelerationStructureArena>& arena)
+    : _vulkanContext(vulkanContext)
+    , _threadPool(threadPool)
+    , _arena(arena)
+{
+}
+
+void BLASBuilder::Add(BottomLevelAccelerationStructure& blas)
+{
+    _pending.push_back(&blas);
+}
+
+void BLASBuilder::Build()
+{
+    std::vector<uint64_t> cacheKeys {};
+    if (_cache)
+    {
+        RestoreFromCache(cacheKeys);
+    }
+
+    if (_pending.empty())
+    {
+        return;
+    }
+
+    const bool hostBuild = _pending.front()->BuildType() == vk::AccelerationStructureBuildTypeKHR::eHost;
+    const vk::DeviceSize scratchAlignment = _vulkanContext->AccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    vk::DeviceSize largestScratchSize = 0;
+    vk::DeviceSize totalScratchSize = 0;
+    for (const auto* blas : _pending)
+    {
+        const vk::DeviceSize scratchSize = VkAlignUp(blas->BuildScratchSize(), scratchAlignment);
+        largestScratchSize = std::max(largestScratchSize, scratchSize);
+        totalScratchSize += scratchSize;
+    }
+
+    const vk::DeviceSize poolSize = std::max(largestScratchSize, std::min(totalScratchSize, SCRATCH_POOL_SIZE));
+
+    // Structures are packed into the pool until the next one doesn't fit anymore, which starts a new batch at the start of the pool
+    std::vector<BuildBatch> batches { BuildBatch {} };
+    std::vector<vk::DeviceSize> scratchOffsets(_pending.size());
+    vk::DeviceSize scratchOffset = 0;
+    for (size_t i = 0; i < _pending.size(); ++i)
+    {
+        const vk::DeviceSize scratchSize = VkAlignUp(_pending[i]->BuildScratchSize(), scratchAlignment);
+        if (scratchOffset + scratchSize > poolSize)
+        {
+            batches.push_back(BuildBatch { i, 0 });
+            scratchOffset = 0;
+        }
+
+        scratchOffsets[i] = scratchOffset;
+        scratchOffset += scratchSize;
+        batches.back().count++;
+    }
+
+    const std::vector<vk::DeviceSize> compactedSizes = hostBuild ? BuildOnHost(batches, scratchOffsets, poolSize) : BuildOnDevice(batches, scratchOffsets, poolSize);
+
+    spdlog::info("[RENDERER] Built {} bottom level acceleration structures on the {} in {} batches, with a scratch pool of {} KiB",
+        _pending.size(), hostBuild ? "host" : "device", batches.size(), poolSize / 1024);
+
+    if (_compact)
+    {
+        Compact(compactedSizes, hostBuild);
+    }
+
+    if (_cache)
+    {
+        _cache->Store(_pending, cacheKeys);
+    }
+
+    _pending.clear();
+}
+
+std::vector<vk::DeviceSize> BLASBuilder::BuildOnDevice(const std::vector<BuildBatch>& batches, const std::vector<vk::DeviceSize>& scratchOffsets, vk::DeviceSize poolSize)
+{
+    const vk::DeviceSize scratchAlignment = _vulkanContext->AccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    // Only lives for the builds, the pool is released before the structures are compacted.
+    // The buffer address itself is not guaranteed to match the scratch alignment, so there is room to align it
+    BufferCreation scratchBufferCreation {};
+    scratchBufferCreation.SetName("BLAS Scratch Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
+        .SetIsMappable(false)
+        .SetSize(poolSize + scratchAlignment);
+    Buffer scratchBuffer(scratchBufferCreation, _vulkanContext);
+    const vk::DeviceAddress scratchAddress = VkAlignUp(_vulkanContext->GetBufferDeviceAddress(scratchBuffer.buffer), scratchAlignment);
+
+    // Scratch memory is accessed as acceleration structure storage by the builds
+    const ImageLayoutTransitionState buildState { vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+        vk::AccessFlagBits2::eAccelerationStructureReadKHR | vk::AccessFlagBits2::eAccelerationStructureWriteKHR };
+
+    vk::QueryPool queryPool {};
+    if (_compact)
+    {
+        vk::QueryPoolCreateInfo queryPoolCreateInfo {};
+        queryPoolCreateInfo.queryType = vk::QueryType::eAccelerationStructureCompactedSizeKHR;
+        queryPoolCreateInfo.queryCount = static_cast<uint32_t>(_pending.size());
+        queryPool = _vulkanContext->Device().createQueryPool(queryPoolCreateInfo);
+    }
+
+    // Vertex and index data is still being copied on the transfer queue
+    SingleTimeCommands commands(_vulkanContext, QueueType::eCompute);
+    commands.WaitFor(QueueType::eTransfer, _vulkanContext->TimelineValue(QueueType::eTransfer), vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR);
+    commands.Record([&](vk::CommandBuffer commandBuffer)
+        {
+            for (const auto& batch : batches)
+            {
+                // The next batch overwrites the scratch memory of the previous one
+                if (batch.first != 0)
+                {
+                    VkGlobalMemoryBarrier(commandBuffer, buildState, buildState);
+                }
+
+                std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos {};
+                std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRangeInfos {};
+                for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+                {
+                    vk::AccelerationStructureBuildGeometryInfoKHR& buildGeometryInfo = buildGeometryInfos.emplace_back(BuildGeometryInfo(i));
+                    buildGeometryInfo.scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+                    buildRangeInfos.push_back(_pending[i]->BuildRangeInfos());
+                }
+
+                commandBuffer.buildAccelerationStructuresKHR(static_cast<uint32_t>(buildGeometryInfos.size()), buildGeometryInfos.data(), buildRangeInfos.data(), _vulkanContext->Dldi());
+            }
+
+            if (!_compact)
+            {
+                return;
+            }
+
+            std::vector<vk::AccelerationStructureKHR> structures {};
+            structures.reserve(_pending.size());
+            for (const auto* blas : _pending)
+            {
+                structures.push_back(blas->Structure());
+            }
+
+            // The compacted sizes are only known once the builds are done
+            VkGlobalMemoryBarrier(commandBuffer, buildState, buildState);
+            commandBuffer.resetQueryPool(queryPool, 0, static_cast<uint32_t>(structures.size()));
+            commandBuffer.writeAccelerationStructuresPropertiesKHR(structures, vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryPool, 0, _vulkanContext->Dldi()); });
+    commands.SubmitAndWait();
+
+    if (!_compact)
+    {
+        return {};
+    }
+
+    const uint32_t queryCount = static_cast<uint32_t>(_pending.size());
+    std::vector<vk::DeviceSize> compactedSizes(queryCount);
+    VkCheckResult(_vulkanContext->Device().getQueryPoolResults(queryPool, 0, queryCount, compactedSizes.size() * sizeof(vk::DeviceSize), compactedSizes.data(),
+                      sizeof(vk::DeviceSize), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait),
+        "[VULKAN] Failed reading compacted acceleration structure sizes!");
+    _vulkanContext->Device().destroyQueryPool(queryPool);
+
+    return compactedSizes;
+}
+
+std::vector<vk::DeviceSize> BLASBuilder::BuildOnHost(const std::vector<BuildBatch>& batches, const std::vector<vk::DeviceSize>& scratchOffsets, vk::DeviceSize poolSize)
+{
+    const vk::DeviceSize scratchAlignment = _vulkanContext->AccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
+
+    std::vector<std::byte> scratchMemory(poolSize + scratchAlignment);
+    std::byte* scratchData = scratchMemory.data() + (VkAlignUp(reinterpret_cast<uintptr_t>(scratchMemory.data()), scratchAlignment) - reinterpret_cast<uintptr_t>(scratchMemory.data()));
+
+    for (const auto& batch : batches)
+    {
+        std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos {};
+        std::vector<const vk::AccelerationStructureBuildRangeInfoKHR*> buildRangeInfos {};
+        for (size_t i = batch.first; i < batch.first + batch.count; ++i)
+        {
+            vk::AccelerationStructureBuildGeometryInfoKHR& buildGeometryInfo = buildGeometryInfos.emplace_back(BuildGeometryInfo(i));
+            buildGeometryInfo.scratchData.hostAddress = scratchData + scratchOffsets[i];
+            buildRangeInfos.push_back(_pending[i]->BuildRangeInfos());
+        }
+
+        // The builds of a batch run as one deferred operation, which the workers of the pool join to share the work
+        const vk::DeferredOperationKHR operation = _vulkanContext->Device().createDeferredOperationKHR(nullptr, _vulkanContext->Dldi());
+        const vk::Result result = _vulkanContext->Device().buildAccelerationStructuresKHR(operation, static_cast<uint32_t>(buildGeometryInfos.size()), buildGeometryInfos.data(), buildRangeInfos.data(), _vulkanContext->Dldi());
+        JoinDeferredOperation(operation, result);
+    }
+
+    if (!_compact)
+    {
+        return {};
+    }
+
+    std::vector<vk::AccelerationStructureKHR> structures {};
+    structures.reserve(_pending.size());
+    for (const auto* blas : _pending)
+    {
+        structures.push_back(blas->Structure());
+    }
+
+    std::vector<vk::DeviceSize> compactedSizes(structures.size());
+    VkCheckResult(_vulkanContext->Device().writeAccelerationStructuresPropertiesKHR(static_cast<uint32_t>(structures.size()), structures.data(), vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+                      compactedSizes.size() * sizeof(vk::DeviceSize), compactedSizes.data(), sizeof(vk::DeviceSize), _vulkanContext->Dldi()),
+        "[VULKAN] Failed reading compacted acceleration structure sizes!");
+
+    return compactedSizes;
+}
+
+vk::AccelerationStructureBuildGeometryInfoKHR BLASBuilder::BuildGeometryInfo(size_t pendingIndex) const
+{
+    vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = _pending[pendingIndex]->BuildGeometryInfo();
+    if (_compact)
+    {
+        buildGeometryInfo.flags |= vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction;
+    }
+    return buildGeometryInfo;
+}
+
+uint64_t BLASBuilder::CacheKey(size_t pendingIndex) const
+{
+    const uint32_t flags = static_cast<uint32_t>(BuildGeometryInfo(pendingIndex).flags);
+    const uint32_t buildType = static_cast<uint32_t>(_pending[pendingIndex]->BuildType());
+    return HashCombine(HashCombine(_pending[pendingIndex]->ContentHash(), flags), buildType);
+}
+
+void BLASBuilder::RestoreFromCache(std::vector<uint64_t>& cacheKeys)
+{
+    cacheKeys.clear();
+    for (size_t i = 0; i < _pending.size(); ++i)
+    {
+        cacheKeys.push_back(CacheKey(i));
+    }
+
+    if (_pending.empty())
+    {
+        return;
+    }
+
+    // Entries are stored after compaction, so restored structures need nothing else
+    const std::vector<bool> restored = _cache->Restore(_pending, cacheKeys);
+
+    size_t remaining = 0;
+    for (size_t i = 0; i < _pending.size(); ++i)
+    {
+        if (!restored[i])
+        {
+            _pending[remaining] = _pending[i];
+            cacheKeys[remaining] = cacheKeys[i];
+            remaining++;
+        }
+    }
+    _pending.resize(remaining);
+    cacheKeys.resize(remaining);
+}
+
+void BLASBuilder::JoinDeferredOperation(vk::DeferredOperationKHR operation, vk::Result result)
+{
+    const vk::Device device = _vulkanContext->Device();
+
+    if (result == vk::Result::eOperationDeferredKHR)
+    {
+        const auto Join = [&]()
+        {
+            // Idle means there is no work for this thread right now, but the operation isn't done yet
+            while (device.deferredOperationJoinKHR(operation, _vulkanContext->Dldi()) == vk::Result::eThreadIdleKHR)
+            {
+                std::this_thread::yield();
+            }
+        };
+
+        const uint32_t maxConcurrency = device.getDeferredOperationMaxConcurrencyKHR(operation, _vulkanContext->Dldi());
+        const uint32_t workerCount = _threadPool ? std::min(maxConcurrency, _threadPool->ThreadCount()) : 0;
+
+        std::vector<std::future<void>> workers {};
+        for (uint32_t i = 0; i < workerCount; ++i)
+        {
+            workers.push_back(_threadPool->Submit(Join));
+        }
+
+        // The calling thread helps out as well, which also guarantees progress without a pool
+        Join();
+        for (auto& worker : workers)
+        {
+            worker.wait();
+        }
+
+        result = device.getDeferredOperationResultKHR(operation, _vulkanContext->Dldi());
+    }
+    else if (result == vk::Result::eOperationNotDeferredKHR)
+    {
+        result = vk::Result::eSuccess;
+    }
+
+    device.destroyDeferredOperationKHR(operation, nullptr, _vulkanContext->Dldi());
+    VkCheckResult(result, "[VULKAN] Failed building acceleration structures on the host!");
+}
+
+void BLASBuilder::Compact(const std::vector<vk::DeviceSize>& compactedSizes, bool hostBuild)
+{
+    vk::DeviceSize originalSize = 0;
+    vk::DeviceSize compactedSize = 0;
+    std::vector<RetiredAccelerationStructure> originals {};
+    originals.reserve(_pending.size());
+
+    const auto CompactAll = [&](vk::CommandBuffer commandBuffer)
+    {
+        for (size_t i = 0; i < _pending.size(); ++i)
+        {
+            originalSize += _pending[i]->StructureSize();
+            compactedSize += compactedSizes[i];
+            originals.push_back(_pending[i]->Compact(commandBuffer, compactedSizes[i]));
+        }
+    };
+
+    // Host copies execute right away, device copies have to finish before the originals can go
+    if (hostBuild)
+    {
+        CompactAll(nullptr);
+    }
+    else
+    {
+        SingleTimeCommands commands(_vulkanContext, QueueType::eCompute);
+        commands.Record(CompactAll);
+        commands.SubmitAndWait();
+    }
+
+    for (const auto& original : originals)
+    {
+        _vulkanContext->Device().destroyAccelerationStructureKHR(original.structure, nullptr, _vulkanContext->Dldi());
+    }
+
+    spdlog::info("[RENDERER] Compacted bottom level acceleration structures from {} KiB to {} KiB", originalSize / 1024, compactedSize / 1024);
+}
@@ -1,17 +1,23 @@
 #include "bottom_level_acceleration_structure.hpp"
 #include "model_loader.hpp"
 #include "resources/bindless_resources.hpp"
-#include "single_time_commands.hpp"
 #include "vk_common.hpp"
 #include "vulkan_context.hpp"
-#include <glm/glm.hpp>
 
-BottomLevelAccelerationStructure::BottomLevelAccelerationStructure(const BLASInput& input, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext)
-    : _transform(input.transform)
+BottomLevelAccelerationStructure::BottomLevelAccelerationStructure(const BLASInput& input, const std::shared_ptr<AccelerationStructureArena>& arena, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext)
+    : _input(input)
+    , _arena(arena)
     , _vulkanContext(vulkanContext)
 {
-    InitializeStructure(input);
-    resources->GeometryNodes().Create(input.node);
+    InitializeTransforms();
+    InitializeStructure();
+
+    // Geometry nodes are created in order, so the geometry index of a hit offsets into them
+    _firstGeometryIndex = static_cast<uint32_t>(resources->GeometryNodes().GetAll().size());
+    for (const auto& node : _input.nodes)
+    {
+        resources->GeometryNodes().Create(node);
+    }
 }
 
 BottomLevelAccelerationStructure::~BottomLevelAccelerationStructure()
@@ -20,59 +26,141 @@ BottomLevelAccelerationStructure::~BottomLevelAccelerationStructure()
 }
 
 BottomLevelAccelerationStructure::BottomLevelAccelerationStructure(BottomLevelAccelerationStructure&& other) noexcept
-    : _transform(other._transform)
+    : _firstGeometryIndex(other._firstGeometryIndex)
+    , _input(std::move(other._input))
+    , _buildScratchSize(other._buildScratchSize)
+    , _arena(other._arena)
+    , _storage(std::move(other._storage))
+    , _transformBuffer(std::move(other._transformBuffer))
     , _vulkanContext(other._vulkanContext)
 {
     _vkStructure = other._vkStructure;
-    _structureBuffer = std::move(other._structureBuffer);
-    _scratchBuffer = std::move(other._scratchBuffer);
-    _instancesBuffer = std::move(other._instancesBuffer);
 
     other._vkStructure = nullptr;
 }
 
-void BottomLevelAccelerationStructure::InitializeStructure(const BLASInput& input)
+vk::AccelerationStructureBuildGeometryInfoKHR BottomLevelAccelerationStructure::BuildGeometryInfo() const
 {
     vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo {};
     buildGeometryInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
     buildGeometryInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
     buildGeometryInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
-    buildGeometryInfo.geometryCount = 1;
-    buildGeometryInfo.pGeometries = &input.geometry;
+    buildGeometryInfo.geometryCount = static_cast<uint32_t>(_input.geometries.size());
+    buildGeometryInfo.pGeometries = _input.geometries.data();
+    buildGeometryInfo.dstAccelerationStructure = _vkStructure;
+    return buildGeometryInfo;
+}
+
+void BottomLevelAccelerationStructure::InitializeTransforms()
+{
+    if (_input.transforms.empty())
+    {
+        return;
+    }
+
+    std::vector<vk::TransformMatrixKHR> transforms {};
+    transforms.reserve(_input.transforms.size());
+    for (const auto& transform : _input.transforms)
+    {
+        transforms.emplace_back(VkGLMToTransformMatrixKHR(transform));
+    }
+
+    BufferCreation transformBufferCreation {};
+    transformBufferCreation.SetName("BLAS Transform Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE)
+        .SetIsMappable(true)
+        .SetSize(transforms.size() * sizeof(vk::TransformMatrixKHR));
+    _transformBuffer = std::make_unique<Buffer>(transformBufferCreation, _vulkanContext);
+    memcpy(_transformBuffer->mappedPtr, transforms.data(), transforms.size() * sizeof(vk::TransformMatrixKHR));
+
+    vk::DeviceOrHostAddressConstKHR transformData {};
+    if (_input.buildType == vk::AccelerationStructureBuildTypeKHR::eHost)
+    {
+        transformData.hostAddress = _transformBuffer->mappedPtr;
+    }
+    else
+    {
+        transformData.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_transformBuffer->buffer);
+    }
+
+    for (size_t i = 0; i < _input.geometries.size(); ++i)
+    {
+        _input.geometries[i].geometry.triangles.transformData = transformData;
+        _input.infos[i].transformOffset = static_cast<uint32_t>(i * sizeof(vk::TransformMatrixKHR));
+    }
+}
+
+void BottomLevelAccelerationStructure::InitializeStructure()
+{
+    const vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = BuildGeometryInfo();
+
+    std::vector<uint32_t> primitiveCounts {};
+    primitiveCounts.reserve(_input.infos.size());
+    for (const auto& info : _input.infos)
+    {
+        primitiveCounts.push_back(info.primitiveCount);
+    }
 
     vk::AccelerationStructureBuildSizesInfoKHR buildSizesInfo = _vulkanContext->Device().getAccelerationStructureBuildSizesKHR(
-        vk::AccelerationStructureBuildTypeKHR::eDevice, buildGeometryInfo, input.info.primitiveCount, _vulkanContext->Dldi());
+        _input.buildType, buildGeometryInfo, primitiveCounts, _vulkanContext->Dldi());
 
-    BufferCreation structureBufferCreation {};
-    structureBufferCreation.SetName("BLAS Structure Buffer")
-        .SetUsageFlags(vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
-        .SetIsMappable(false)
-        .SetSize(buildSizesInfo.accelerationStructureSize);
-    _structureBuffer = std::make_unique<Buffer>(structureBufferCreation, _vulkanContext);
+    AllocateStructure(buildSizesInfo.accelerationStructureSize);
+    _buildScratchSize = buildSizesInfo.buildScratchSize;
+}
 
-    vk::AccelerationStructureCreateInfoKHR createInfo {};
-    createInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
-    createInfo.buffer = _structureBuffer->buffer;
-    createInfo.size = buildSizesInfo.accelerationStructureSize;
-    _vkStructure = _vulkanContext->Device().createAccelerationStructureKHR(createInfo, nullptr, _vulkanContext->Dldi());
+RetiredAccelerationStructure BottomLevelAccelerationStructure::Compact(vk::CommandBuffer commandBuffer, vk::DeviceSize compactedSize)
+{
+    RetiredAccelerationStructure original { _vkStructure, std::move(_storage) };
+    AllocateStructure(compactedSize);
 
-    BufferCreation scratchBufferCreation {};
-    scratchBufferCreation.SetName("BLAS Scratch Buffer")
-        .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
-        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
-        .SetIsMappable(false)
-        .SetSize(buildSizesInfo.buildScratchSize);
-    _scratchBuffer = std::make_unique<Buffer>(scratchBufferCreation, _vulkanContext);
+    vk::CopyAccelerationStructureInfoKHR copyInfo {};
+    copyInfo.src = original.structure;
+    copyInfo.dst = _vkStructure;
+    copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eCompact;
 
-    // Fill in remaining data
-    buildGeometryInfo.dstAccelerationStructure = _vkStructure;
-    buildGeometryInfo.scratchData.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_scratchBuffer->buffer);
+    if (_input.buildType == vk::AccelerationStructureBuildTypeKHR::eHost)
+    {
+        VkCheckResult(_vulkanContext->Device().copyAccelerationStructureKHR(nullptr, copyInfo, _vulkanContext->Dldi()), "[VULKAN] Failed compacting acceleration structure on the host!");
+    }
+    else
+    {
+        commandBuffer.copyAccelerationStructureKHR(copyInfo, _vulkanContext->Dldi());
+    }
+
+    return original;
+}
+
+RetiredAccelerationStructure BottomLevelAccelerationStructure::Deserialize(vk::CommandBuffer commandBuffer, vk::DeviceOrHostAddressConstKHR data, vk::DeviceSize structureSize)
+{
+    RetiredAccelerationStructure original { _vkStructure, std::move(_storage) };
+    AllocateStructure(structureSize);
+
+    vk::CopyMemoryToAccelerationStructureInfoKHR copyInfo {};
+    copyInfo.src = data;
+    copyInfo.dst = _vkStructure;
+    copyInfo.mode = vk::CopyAccelerationStructureModeKHR::eDeserialize;
 
-    std::array<const vk::AccelerationStructureBuildRangeInfoKHR*, 1> pBuildRangeInfos = { &input.info };
+    if (_input.buildType == vk::AccelerationStructureBuildTypeKHR::eHost)
+    {
+        VkCheckResult(_vulkanContext->Device().copyMemoryToAccelerationStructureKHR(nullptr, copyInfo, _vulkanContext->Dldi()), "[VULKAN] Failed deserializing acceleration structure on the host!");
+    }
+    else
+    {
+        commandBuffer.copyMemoryToAccelerationStructureKHR(copyInfo, _vulkanContext->Dldi());
+    }
 
-    SingleTimeCommands singleTimeCommands { _vulkanContext };
-    singleTimeCommands.Record([&](vk::CommandBuffer commandBuffer)
-        { commandBuffer.buildAccelerationStructuresKHR(1, &buildGeometryInfo, pBuildRangeInfos.data(), _vulkanContext->Dldi()); });
-    singleTimeCommands.SubmitAndWait();
+    return original;
+}
+
+void BottomLevelAccelerationStructure::AllocateStructure(vk::DeviceSize size)
+{
+    _storage = _arena->Allocate(size);
+
+    vk::AccelerationStructureCreateInfoKHR createInfo {};
+    createInfo.type = vk::AccelerationStructureTypeKHR::eBottomLevel;
+    createInfo.buffer = _storage.buffer;
+    createInfo.offset = _storage.offset;
+    createInfo.size = size;
+    _vkStructure = _vulkanContext->Device().createAccelerationStructureKHR(createInfo, nullptr, _vulkanContext->Dldi());
 }
@@ -0,0 +1,118 @@
+#include "compressed_texture_cache.hpp"
+#include "vk_common.hpp"
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+CompressedTextureCache::CompressedTextureCache(const std::filesystem::path& directory)
+    : _directory(directory)
+{
+}
+
+std::optional<TextureData> CompressedTextureCache::Load(uint64_t key) const
+{
+    const std::filesystem::path path = EntryPath(key);
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return std::nullopt;
+    }
+
+    EntryHeader header {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != ENTRY_MAGIC)
+    {
+        spdlog::warn("[FILE] Ignoring invalid texture cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    if (header.version != ENTRY_VERSION)
+    {
+        return std::nullopt;
+    }
+
+    TextureData texture {};
+    texture.format = static_cast<vk::Format>(header.format);
+    texture.width = header.width;
+    texture.height = header.height;
+    texture.mipLevels = header.mipLevels;
+
+    // The header is validated before anything is allocated for the data, a corrupted entry could claim any size.
+    // Formats the cache doesn't write have no level size, which leaves the expected size at 0
+    vk::DeviceSize expectedSize = 0;
+    if (texture.width > 0 && texture.height > 0 && texture.mipLevels > 0 && texture.mipLevels <= VkMipLevelCount(texture.width, texture.height))
+    {
+        for (uint32_t i = 0; i < texture.mipLevels; ++i)
+        {
+            expectedSize += VkMipLevelSize(texture.format, texture.width, texture.height, i);
+        }
+    }
+
+    if (expectedSize == 0 || header.dataSize != expectedSize)
+    {
+        spdlog::warn("[FILE] Ignoring invalid texture cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    texture.data.resize(header.dataSize);
+    if (!file.read(reinterpret_cast<char*>(texture.data.data()), static_cast<std::streamsize>(texture.data.size())))
+    {
+        spdlog::warn("[FILE] Ignoring truncated texture cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    return texture;
+}
+
+void CompressedTextureCache::Store(uint64_t key, const TextureData& texture) const
+{
+    std::error_code error {};
+    std::filesystem::create_directories(_directory, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed creating texture cache directory {}: {}", _directory.string(), error.message());
+        return;
+    }
+
+    const EntryHeader header {
+        .magic = ENTRY_MAGIC,
+        .version = ENTRY_VERSION,
+        .format = static_cast<uint32_t>(texture.format),
+        .width = texture.width,
+        .height = texture.height,
+        .mipLevels = texture.mipLevels,
+        .dataSize = texture.data.size(),
+    };
+
+    // Written next to the entry and moved in place, so an interrupted write never leaves a truncated entry behind.
+    // The name is unique per thread, as other threads can be writing the same entry for another model
+    const std::filesystem::path path = EntryPath(key);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += fmt::format(".{}.tmp", std::hash<std::thread::id> {}(std::this_thread::get_id()));
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        const bool written = file.write(reinterpret_cast<const char*>(&header), sizeof(header))
+            && file.write(reinterpret_cast<const char*>(texture.data.data()), static_cast<std::streamsize>(texture.data.size()));
+        if (!written)
+        {
+            spdlog::warn("[FILE] Failed writing texture cache entry: {}", temporaryPath.string());
+            // Closed first, as open files can't be removed on every platform
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed writing texture cache entry {}: {}", path.string(), error.message());
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
+
+std::filesystem::path CompressedTextureCache::EntryPath(uint64_t key) const
+{
+    return _directory / fmt::format("{:016x}.bctex", key);
+}
@@ -0,0 +1,42 @@
+#include "hash.hpp"
+#include <bit>
+#include <cstring>
+
+constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+
+uint64_t HashMixWord(uint64_t hash, uint64_t word)
+{
+    hash ^= std::rotl(word * PRIME_2, 31) * PRIME_1;
+    return std::rotl(hash, 27) * PRIME_1 + PRIME_3;
+}
+
+// Consumes the data a word at a time, which keeps hashing large vertex buffers cheap compared to loading them
+uint64_t HashBytes(std::span<const std::byte> data, uint64_t seed)
+{
+    uint64_t hash = seed + PRIME_3 + data.size();
+
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= data.size(); offset += sizeof(uint64_t))
+    {
+        uint64_t word {};
+        std::memcpy(&word, data.data() + offset, sizeof(uint64_t));
+        hash = HashMixWord(hash, word);
+    }
+
+    if (offset < data.size())
+    {
+        uint64_t word {};
+        std::memcpy(&word, data.data() + offset, data.size() - offset);
+        hash = HashMixWord(hash, word);
+    }
+
+    // Final avalanche, so every input bit affects every output bit
+    hash ^= hash >> 33;
+    hash *= PRIME_2;
+    hash ^= hash >> 29;
+    hash *= PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,240 @@
+#include "ktx_texture.hpp"
+#include "vk_common.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <transcoder/basisu_transcoder.h>
+
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+// Header and index at the start of the file, see the KTX 2.0 specification
+struct KTX2Header
+{
+    std::array<uint8_t, 12> identifier {};
+    uint32_t vkFormat {};
+    uint32_t typeSize {};
+    uint32_t pixelWidth {};
+    uint32_t pixelHeight {};
+    uint32_t pixelDepth {};
+    uint32_t layerCount {};
+    uint32_t faceCount {};
+    uint32_t levelCount {};
+    uint32_t supercompressionScheme {};
+    uint32_t dfdByteOffset {};
+    uint32_t dfdByteLength {};
+    uint32_t kvdByteOffset {};
+    uint32_t kvdByteLength {};
+    uint64_t sgdByteOffset {};
+    uint64_t sgdByteLength {};
+};
+static_assert(sizeof(KTX2Header) == 80);
+
+// Follows the header for every level, starting with the largest one
+struct KTX2LevelIndex
+{
+    uint64_t byteOffset {};
+    uint64_t byteLength {};
+    uint64_t uncompressedByteLength {};
+};
+
+enum class KTX2Supercompression : uint32_t
+{
+    eNone = 0,
+    eBasisLZ = 1,
+    eZstandard = 2,
+    eZLIB = 3,
+};
+
+// Formats that are uploaded as they are stored. The sRGB ones are read as UNORM, like the textures that are
+// decoded from images, as the shaders expect the values they were authored with
+std::optional<vk::Format> UploadFormat(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+        return vk::Format::eR8G8B8A8Unorm;
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+        return vk::Format::eBc1RgbaUnormBlock;
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+        return vk::Format::eBc3UnormBlock;
+    case vk::Format::eBc4UnormBlock:
+        return vk::Format::eBc4UnormBlock;
+    case vk::Format::eBc5UnormBlock:
+        return vk::Format::eBc5UnormBlock;
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return vk::Format::eBc7UnormBlock;
+    default:
+        return std::nullopt;
+    }
+}
+
+basist::transcoder_texture_format BasisTargetFormat(TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::eBC4:
+        return basist::transcoder_texture_format::cTFBC4_R;
+    case TextureCompression::eBC5:
+        return basist::transcoder_texture_format::cTFBC5_RG;
+    case TextureCompression::eBC7:
+        return basist::transcoder_texture_format::cTFBC7_RGBA;
+    default:
+        return basist::transcoder_texture_format::cTFRGBA32;
+    }
+}
+
+// Copies the levels out of the file, checking they have the size the format expects for them
+TextureData ReadLevels(std::span<const std::byte> bytes, const KTX2Header& header, vk::Format format, uint32_t levelCount)
+{
+    TextureData texture {};
+    const size_t levelIndexSize = sizeof(KTX2LevelIndex) * levelCount;
+    if (bytes.size() < sizeof(KTX2Header) + levelIndexSize)
+    {
+        spdlog::error("[FILE] KTX2 level index is truncated");
+        return texture;
+    }
+
+    std::vector<KTX2LevelIndex> levels(levelCount);
+    std::memcpy(levels.data(), bytes.data() + sizeof(KTX2Header), levelIndexSize);
+
+    vk::DeviceSize size = 0;
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        const KTX2LevelIndex& level = levels[i];
+        if (level.byteLength != VkMipLevelSize(format, header.pixelWidth, header.pixelHeight, i) || level.byteOffset > bytes.size() || level.byteLength > bytes.size() - level.byteOffset)
+        {
+            spdlog::error("[FILE] KTX2 level {} doesn't match the size of a {}x{} {} level", i, header.pixelWidth, header.pixelHeight, vk::to_string(format));
+            return texture;
+        }
+        size += level.byteLength;
+    }
+
+    texture.format = format;
+    texture.width = header.pixelWidth;
+    texture.height = header.pixelHeight;
+    texture.mipLevels = levelCount;
+    texture.data.reserve(size);
+    for (const auto& level : levels)
+    {
+        texture.data.insert(texture.data.end(), bytes.begin() + level.byteOffset, bytes.begin() + level.byteOffset + level.byteLength);
+    }
+
+    return texture;
+}
+
+// Basis Universal stores ETC1S or UASTC blocks, which are turned into blocks of the target format level by level
+TextureData TranscodeLevels(std::span<const std::byte> bytes, TextureCompression compression)
+{
+    // Fills the lookup tables shared by all transcoders, once
+    static const bool transcoderInitialized = []()
+    {
+        basist::basisu_transcoder_init();
+        return true;
+    }();
+    (void)transcoderInitialized;
+
+    TextureData texture {};
+    basist::ktx2_transcoder transcoder {};
+    if (!transcoder.init(bytes.data(), static_cast<uint32_t>(bytes.size())) || !transcoder.start_transcoding())
+    {
+        spdlog::error("[FILE] Failed to start transcoding Basis Universal KTX2 texture");
+        return texture;
+    }
+
+    const basist::transcoder_texture_format targetFormat = BasisTargetFormat(compression);
+    const vk::Format format = TextureCompressionFormat(compression);
+    const uint32_t width = transcoder.get_width();
+    const uint32_t height = transcoder.get_height();
+    const uint32_t levelCount = std::max(transcoder.get_levels(), 1u);
+
+    std::vector<std::byte> data {};
+    for (uint32_t level = 0; level < levelCount; ++level)
+    {
+        basist::ktx2_image_level_info levelInfo {};
+        if (!transcoder.get_image_level_info(levelInfo, level, 0, 0))
+        {
+            spdlog::error("[FILE] Failed to read level {} of Basis Universal KTX2 texture", level);
+            return texture;
+        }
+
+        // Sized in blocks for block compressed targets, in pixels otherwise
+        const uint32_t outputSize = VkIsBlockCompressed(format) ? levelInfo.m_total_blocks : levelInfo.m_orig_width * levelInfo.m_orig_height;
+        const size_t offset = data.size();
+        data.resize(offset + VkMipLevelSize(format, width, height, level));
+
+        if (!transcoder.transcode_image_level(level, 0, 0, data.data() + offset, outputSize, targetFormat))
+        {
+            spdlog::error("[FILE] Failed to transcode level {} of Basis Universal KTX2 texture", level);
+            return texture;
+        }
+    }
+
+    texture.format = format;
+    texture.width = width;
+    texture.height = height;
+    texture.mipLevels = levelCount;
+    texture.data = std::move(data);
+    return texture;
+}
+
+bool IsKTX2(std::span<const std::byte> bytes)
+{
+    return bytes.size() >= KTX2_IDENTIFIER.size() && std::memcmp(bytes.data(), KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size()) == 0;
+}
+
+TextureData LoadKTX2(std::span<const std::byte> bytes, TextureCompression compression)
+{
+    if (!IsKTX2(bytes) || bytes.size() < sizeof(KTX2Header))
+    {
+        spdlog::error("[FILE] Not a KTX2 file");
+        return {};
+    }
+
+    KTX2Header header {};
+    std::memcpy(&header, bytes.data(), sizeof(KTX2Header));
+
+    // Only plain 2D textures are used by materials
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1)
+    {
+        spdlog::error("[FILE] KTX2 texture is not a 2D texture ({}x{}x{}, {} layers, {} faces)", header.pixelWidth, header.pixelHeight, header.pixelDepth, header.layerCount, header.faceCount);
+        return {};
+    }
+
+    // A level count of 0 asks for the chain to be generated at load, which only happens for decoded images, so just the base level is used
+    const uint32_t levelCount = std::max(header.levelCount, 1u);
+    if (levelCount > VkMipLevelCount(header.pixelWidth, header.pixelHeight))
+    {
+        spdlog::error("[FILE] KTX2 texture has {} levels, more than a {}x{} texture can have", levelCount, header.pixelWidth, header.pixelHeight);
+        return {};
+    }
+
+    const auto supercompression = static_cast<KTX2Supercompression>(header.supercompressionScheme);
+    const auto format = static_cast<vk::Format>(header.vkFormat);
+
+    // ETC1S is always BasisLZ supercompressed, UASTC has no Vulkan format and is optionally Zstandard supercompressed
+    if (supercompression == KTX2Supercompression::eBasisLZ || format == vk::Format::eUndefined)
+    {
+        return TranscodeLevels(bytes, compression);
+    }
+
+    if (supercompression != KTX2Supercompression::eNone)
+    {
+        spdlog::error("[FILE] KTX2 texture uses unsupported supercompression scheme {}", header.supercompressionScheme);
+        return {};
+    }
+
+    const std::optional<vk::Format> uploadFormat = UploadFormat(format);
+    if (!uploadFormat)
+    {
+        spdlog::error("[FILE] KTX2 texture uses unsupported format {}", vk::to_string(format));
+        return {};
+    }
+
+    return ReadLevels(bytes, header, uploadFormat.value(), levelCount);
+}
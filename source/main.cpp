@@ -1,7 +1,16 @@
 #include "application.hpp"
+#include "batch_runner.hpp"
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[])
+int main(int argc, char* argv[])
 {
-    Application app {};
+    const ApplicationSettings settings = ApplicationSettings::FromArguments(argc, argv);
+
+    if (!settings.batchManifestPath.empty())
+    {
+        BatchRunner batchRunner { settings.batchManifestPath };
+        return batchRunner.Run();
+    }
+
+    Application app { settings };
     return app.Run();
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+#include "mapped_file.hpp"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    _fileHandle = file;
+
+    LARGE_INTEGER size {};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        return;
+    }
+    _mappingHandle = mapping;
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        return;
+    }
+
+    _data = { static_cast<const std::byte*>(view), static_cast<size_t>(size.QuadPart) };
+}
+
+MappedFile::~MappedFile()
+{
+    if (!_data.empty())
+    {
+        UnmapViewOfFile(_data.data());
+    }
+    if (_mappingHandle != nullptr)
+    {
+        CloseHandle(_mappingHandle);
+    }
+    if (_fileHandle != nullptr)
+    {
+        CloseHandle(_fileHandle);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    const int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file == -1)
+    {
+        return;
+    }
+
+    struct stat status {};
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (view != MAP_FAILED)
+        {
+            _data = { static_cast<const std::byte*>(view), static_cast<size_t>(status.st_size) };
+        }
+    }
+
+    close(file);
+}
+
+MappedFile::~MappedFile()
+{
+    if (!_data.empty())
+    {
+        munmap(const_cast<std::byte*>(_data.data()), _data.size());
+    }
+}
+
+#endif
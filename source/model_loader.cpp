@@ -1,90 +1,211 @@
 #include "model_loader.hpp"
+#include "compressed_texture_cache.hpp"
+#include "hash.hpp"
+#include "ktx_texture.hpp"
+#include "mapped_file.hpp"
 #include "resources/bindless_resources.hpp"
 #include "resources/gpu_resources.hpp"
-#include "single_time_commands.hpp"
+#include "scene_cache.hpp"
+#include "texture_compression.hpp"
+#include "thread_pool.hpp"
+#include "upload_manager.hpp"
 #include "vk_common.hpp"
 #include <assimp/GltfMaterial.h>
+#include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#include <algorithm>
+#include <array>
 #include <filesystem>
+#include <fstream>
 #include <glm/gtc/type_ptr.hpp>
 #include <spdlog/spdlog.h>
 #include <stb_image.h>
 
-ResourceHandle<Image> ProcessImage(const std::string_view localPath, const std::string_view directory, const std::shared_ptr<BindlessResources>& resources)
+// Frees the pixels with stb_image, since they are allocated by it
+struct StbiImageDeleter
 {
-    ImageCreation imageCreation {};
-    imageCreation.SetName(localPath)
-        .SetFormat(vk::Format::eR8G8B8A8Unorm)
-        .SetUsageFlags(vk::ImageUsageFlagBits::eSampled);
+    void operator()(stbi_uc* pixels) const { stbi_image_free(pixels); }
+};
 
-    int32_t width {}, height {}, nrChannels {};
-
-    const std::string fullPath = std::string(directory) + "/" + std::string { localPath.begin(), localPath.end() };
+// The file contents of a texture, hashed to find copies of it under other paths
+struct EncodedImage
+{
+    std::vector<std::byte> bytes {};
+    uint64_t contentHash {};
+};
 
-    unsigned char* stbiData = stbi_load(fullPath.c_str(), &width, &height, &nrChannels, 4);
+// Only touch the file and their own allocations, so they are safe to run on any thread
+EncodedImage ReadImage(const std::string& path)
+{
+    EncodedImage image {};
 
-    if (!stbiData)
+    std::ifstream file { path, std::ios::ate | std::ios::binary };
+    if (!file.is_open())
     {
-        spdlog::error("[GLTF] Failed to load data from image [{}] from path [{}]", imageCreation.name, fullPath);
-        return ResourceHandle<Image> {};
+        return image;
     }
 
-    std::vector<std::byte> data = std::vector<std::byte>(width * height * 4);
-    std::memcpy(data.data(), std::bit_cast<std::byte*>(stbiData), data.size());
-    stbi_image_free(stbiData);
-
-    imageCreation.SetSize(width, height)
-        .SetData(data);
-
-    return resources->Images().Create(imageCreation);
+    image.bytes.resize(file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(image.bytes.data()), static_cast<std::streamsize>(image.bytes.size()));
+    image.contentHash = HashBytes(image.bytes);
+    return image;
 }
 
-ResourceHandle<Image> LoadTexture(const std::string_view localPath, const std::string_view directory, const std::shared_ptr<BindlessResources>& resources, std::vector<ResourceHandle<Image>>& textures, std::unordered_map<std::string_view, ResourceHandle<Image>>& imageCache)
+// Box filters every level from the one above it, odd sizes repeat their last row or column
+void GenerateMipLevels(std::span<std::byte> pixels, uint32_t width, uint32_t height, uint32_t mipLevels)
 {
-    const auto it = imageCache.find(localPath);
+    constexpr uint32_t channels = 4;
+    auto* source = reinterpret_cast<uint8_t*>(pixels.data());
 
-    if (it == imageCache.end())
+    for (uint32_t level = 1; level < mipLevels; ++level)
     {
-        ResourceHandle<Image> image = ProcessImage(localPath, directory, resources);
-        textures.push_back(image);
-        return image;
-    }
+        const uint32_t sourceWidth = std::max(width >> (level - 1), 1u);
+        const uint32_t sourceHeight = std::max(height >> (level - 1), 1u);
+        const uint32_t levelWidth = std::max(width >> level, 1u);
+        const uint32_t levelHeight = std::max(height >> level, 1u);
+        uint8_t* destination = source + VkMipLevelSize(vk::Format::eR8G8B8A8Unorm, width, height, level - 1);
+
+        for (uint32_t y = 0; y < levelHeight; ++y)
+        {
+            const uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+            const uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
 
-    return it->second;
+            for (uint32_t x = 0; x < levelWidth; ++x)
+            {
+                const uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+                const uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+
+                for (uint32_t c = 0; c < channels; ++c)
+                {
+                    const uint32_t sum = source[(y0 * sourceWidth + x0) * channels + c] + source[(y0 * sourceWidth + x1) * channels + c]
+                        + source[(y1 * sourceWidth + x0) * channels + c] + source[(y1 * sourceWidth + x1) * channels + c];
+                    destination[(y * levelWidth + x) * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+
+        source = destination;
+    }
 }
 
-ResourceHandle<Material> ProcessMaterial(const aiMaterial* aiMaterial, const std::string_view directory, const std::shared_ptr<BindlessResources>& resources, std::vector<ResourceHandle<Image>>& textures, std::unordered_map<std::string_view, ResourceHandle<Image>>& imageCache)
+// Also generates the mip chain, while still on the worker thread. Empty data when decoding failed
+TextureData DecodeImage(const std::vector<std::byte>& bytes)
 {
-    MaterialCreation materialCreation {};
+    TextureData image {};
+    int32_t width {}, height {}, nrChannels {};
+    const std::unique_ptr<stbi_uc, StbiImageDeleter> decoded { stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()), static_cast<int32_t>(bytes.size()), &width, &height, &nrChannels, 4) };
+    if (!decoded)
+    {
+        return image;
+    }
 
-    // Textures
+    image.format = vk::Format::eR8G8B8A8Unorm;
+    image.width = width;
+    image.height = height;
+    image.mipLevels = VkMipLevelCount(image.width, image.height);
 
-    aiString texturePath {};
+    vk::DeviceSize size = 0;
+    for (uint32_t i = 0; i < image.mipLevels; ++i)
+    {
+        size += VkMipLevelSize(image.format, image.width, image.height, i);
+    }
+
+    image.data.resize(size);
+    std::memcpy(image.data.data(), decoded.get(), VkMipLevelSize(image.format, image.width, image.height, 0));
+    GenerateMipLevels(image.data, image.width, image.height, image.mipLevels);
+    return image;
+}
 
-    if (aiMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath) == AI_SUCCESS)
+// Encoding takes far longer than decoding, so compressed textures are looked up in the cache before either happens.
+// KTX2 files already hold their final levels, which skip both
+TextureData LoadTextureData(const std::vector<std::byte>& bytes, TextureCompression compression, uint64_t cacheKey, const std::shared_ptr<CompressedTextureCache>& cache)
+{
+    if (IsKTX2(bytes))
     {
-        materialCreation.albedoMap = LoadTexture(texturePath.C_Str(), directory, resources, textures, imageCache);
+        return LoadKTX2(bytes, compression);
     }
 
-    if (aiMaterial->GetTexture(aiTextureType_GLTF_METALLIC_ROUGHNESS, 0, &texturePath) == AI_SUCCESS)
+    const bool cached = cache && compression != TextureCompression::eNone;
+    if (cached)
     {
-        materialCreation.metallicRoughnessMap = LoadTexture(texturePath.C_Str(), directory, resources, textures, imageCache);
+        if (std::optional<TextureData> texture = cache->Load(cacheKey))
+        {
+            return std::move(texture.value());
+        }
     }
 
-    if (aiMaterial->GetTexture(aiTextureType_NORMALS, 0, &texturePath) == AI_SUCCESS)
+    TextureData texture = DecodeImage(bytes);
+    if (texture.data.empty() || compression == TextureCompression::eNone)
     {
-        materialCreation.normalMap = LoadTexture(texturePath.C_Str(), directory, resources, textures, imageCache);
+        return texture;
     }
 
-    if (aiMaterial->GetTexture(aiTextureType_AMBIENT_OCCLUSION, 0, &texturePath) == AI_SUCCESS)
+    texture = CompressTexture(texture, compression);
+    if (cached)
     {
-        materialCreation.occlusionMap = LoadTexture(texturePath.C_Str(), directory, resources, textures, imageCache);
+        cache->Store(cacheKey, texture);
     }
+    return texture;
+}
+
+// Key of a texture in the path cache, normalized so different spellings of the same file are found
+std::string TexturePath(const std::string_view directory, const std::string_view localPath)
+{
+    return (std::filesystem::path(directory) / localPath).lexically_normal().generic_string();
+}
+
+// Texture paths of a model are relative to this
+std::string_view ModelDirectory(const std::string_view path)
+{
+    return path.substr(0, path.find_last_of('/'));
+}
 
-    if (aiMaterial->GetTexture(aiTextureType_EMISSIVE, 0, &texturePath) == AI_SUCCESS)
+// The texture types read by ProcessMaterial in the order of the material slots, with the compression that fits what they hold.
+// Metallic and roughness are in the green and blue channels, which only BC7 keeps both of
+struct MaterialTexture
+{
+    aiTextureType type;
+    TextureCompression compression;
+};
+
+constexpr std::array<MaterialTexture, SceneMaterial::TEXTURE_SLOTS> MATERIAL_TEXTURES { {
+    { aiTextureType_DIFFUSE, TextureCompression::eBC7 },
+    { aiTextureType_GLTF_METALLIC_ROUGHNESS, TextureCompression::eBC7 },
+    { aiTextureType_NORMALS, TextureCompression::eBC5 },
+    { aiTextureType_AMBIENT_OCCLUSION, TextureCompression::eBC4 },
+    { aiTextureType_EMISSIVE, TextureCompression::eBC7 },
+} };
+
+SceneMaterial ProcessMaterial(const aiMaterial* aiMaterial, std::vector<SceneTexture>& textures)
+{
+    SceneMaterial material {};
+    MaterialCreation& materialCreation = material.creation;
+
+    // Textures, shared between the materials that use the same file
+
+    for (size_t slot = 0; slot < MATERIAL_TEXTURES.size(); ++slot)
     {
-        materialCreation.emissiveMap = LoadTexture(texturePath.C_Str(), directory, resources, textures, imageCache);
+        aiString texturePath {};
+        if (aiMaterial->GetTexture(MATERIAL_TEXTURES[slot].type, 0, &texturePath) != AI_SUCCESS)
+        {
+            continue;
+        }
+
+        const std::string path = std::filesystem::path(texturePath.C_Str()).lexically_normal().generic_string();
+        const auto it = std::find_if(textures.begin(), textures.end(), [&](const SceneTexture& texture)
+            { return texture.path == path; });
+        if (it == textures.end())
+        {
+            material.textures[slot] = static_cast<uint32_t>(textures.size());
+            textures.push_back(SceneTexture { .path = path, .compression = MATERIAL_TEXTURES[slot].compression });
+        }
+        else
+        {
+            material.textures[slot] = static_cast<uint32_t>(std::distance(textures.begin(), it));
+            it->compression = std::max(it->compression, MATERIAL_TEXTURES[slot].compression);
+        }
     }
 
     // Properties
@@ -122,12 +243,12 @@ ResourceHandle<Material> ProcessMaterial(const aiMaterial* aiMaterial, const std
         materialCreation.occlusionStrength = factor;
     }
 
-    return resources->Materials().Create(materialCreation);
+    return material;
 }
 
-Mesh ProcessMesh(const aiScene* aiScene, const aiMesh* aiMesh, const std::vector<ResourceHandle<Material>>& materials, std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices)
+SceneMesh ProcessMesh(const aiScene* aiScene, const aiMesh* aiMesh, std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices)
 {
-    Mesh mesh {};
+    SceneMesh mesh {};
     mesh.firstIndex = static_cast<uint32_t>(indices.size());
     mesh.firstVertex = static_cast<uint32_t>(vertices.size());
 
@@ -181,10 +302,14 @@ Mesh ProcessMesh(const aiScene* aiScene, const aiMesh* aiMesh, const std::vector
         }
     }
 
+    // Indices are offset by the first vertex, which is the same every time the model is loaded
+    mesh.geometryHash = HashBytes(std::as_bytes(std::span<const aiVector3D>(aiMesh->mVertices, aiMesh->mNumVertices)));
+    mesh.geometryHash = HashSpan(std::span<const uint32_t>(indices).subspan(mesh.firstIndex, mesh.indexCount), mesh.geometryHash);
+
     // Material
     if (aiMesh->mMaterialIndex < aiScene->mNumMaterials)
     {
-        mesh.material = materials[aiMesh->mMaterialIndex]; // Order of materials is the same as assimp loads them, so we get the correct one from our vector with the same index
+        mesh.material = aiMesh->mMaterialIndex; // Order of materials is the same as assimp loads them, so we get the correct one from our vector with the same index
     }
 
     return mesh;
@@ -230,6 +355,57 @@ void ProcessNode(const aiNode* aiNode, const Node* parent, std::vector<Node>& no
     }
 }
 
+// Bounds of the positions referenced by the triangles of each mesh, in object space
+std::vector<Bounds> ProcessMeshBounds(const SceneData& scene)
+{
+    std::vector<Bounds> meshBounds(scene.meshes.size());
+
+    for (size_t meshIndex = 0; meshIndex < scene.meshes.size(); ++meshIndex)
+    {
+        const SceneMesh& mesh = scene.meshes[meshIndex];
+        for (uint32_t i = mesh.firstIndex; i < mesh.firstIndex + mesh.indexCount; ++i)
+        {
+            meshBounds[meshIndex].Grow(scene.vertices[scene.indices[i]].position);
+        }
+    }
+
+    return meshBounds;
+}
+
+// Collects the object space triangles of each mesh with an emissive material, so they can be sampled explicitly as lights
+// once the instances referencing the mesh place them in the scene. Empty for the other meshes
+std::vector<std::vector<EmissiveTriangleCreation>> ProcessEmissiveTriangles(const SceneData& scene)
+{
+    std::vector<std::vector<EmissiveTriangleCreation>> meshTriangles(scene.meshes.size());
+
+    for (size_t meshIndex = 0; meshIndex < scene.meshes.size(); ++meshIndex)
+    {
+        const SceneMesh& mesh = scene.meshes[meshIndex];
+        if (mesh.material >= scene.materials.size())
+        {
+            continue;
+        }
+
+        const glm::vec3 emission = scene.materials[mesh.material].creation.emissiveFactor;
+        if (glm::all(glm::lessThanEqual(emission, glm::vec3(0.0f))))
+        {
+            continue;
+        }
+
+        std::vector<EmissiveTriangleCreation>& triangles = meshTriangles[meshIndex];
+        for (uint32_t i = mesh.firstIndex; i < mesh.firstIndex + mesh.indexCount; i += 3)
+        {
+            EmissiveTriangleCreation& triangleCreation = triangles.emplace_back();
+            triangleCreation.p0 = scene.vertices[scene.indices[i]].position;
+            triangleCreation.p1 = scene.vertices[scene.indices[i + 1]].position;
+            triangleCreation.p2 = scene.vertices[scene.indices[i + 2]].position;
+            triangleCreation.emission = emission;
+        }
+    }
+
+    return meshTriangles;
+}
+
 size_t CountNodes(const aiNode* aiNode)
 {
     size_t count = 1;
@@ -250,6 +426,125 @@ std::vector<Node> ProcessNodes(const aiScene* aiScene)
     return nodes;
 }
 
+// The vertices and indices of the scene point into the passed storage
+SceneData ImportScene(const aiScene* aiScene, std::vector<Model::Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    SceneData scene {};
+    scene.name = aiScene->mName.C_Str();
+
+    for (uint32_t i = 0; i < aiScene->mNumMaterials; ++i)
+    {
+        scene.materials.push_back(ProcessMaterial(aiScene->mMaterials[i], scene.textures));
+    }
+
+    for (uint32_t i = 0; i < aiScene->mNumMeshes; ++i)
+    {
+        scene.meshes.push_back(ProcessMesh(aiScene, aiScene->mMeshes[i], vertices, indices));
+    }
+
+    scene.vertices = vertices;
+    scene.indices = indices;
+    scene.nodes = ProcessNodes(aiScene);
+    return scene;
+}
+
+// Everything of a model that can be prepared without registering resources, so it's done by the task that imports it
+struct ImportedModel
+{
+    SceneData scene {};
+    // Storage of the scene's vertices and indices, the mapped cache entry or the imported arrays. Moving it keeps the views valid
+    std::unique_ptr<MappedFile> file {};
+    std::vector<Model::Vertex> vertices {};
+    std::vector<uint32_t> indices {};
+    // With its geometry buffers created and their uploads recorded
+    std::shared_ptr<Model> model {};
+    // One entry per mesh
+    std::vector<Bounds> meshBounds {};
+    std::vector<std::vector<EmissiveTriangleCreation>> emissiveTriangles {};
+};
+
+// Runs on the thread pool, with an importer per thread. Creating buffers and recording uploads is thread safe,
+// images and materials are registered once all models are imported
+std::optional<ImportedModel> ImportModel(const std::string& path, const std::shared_ptr<SceneCache>& sceneCache, const std::shared_ptr<VulkanContext>& vulkanContext, UploadManager& uploads)
+{
+    ImportedModel imported {};
+
+    std::optional<CachedScene> cached = sceneCache ? sceneCache->Load(path) : std::nullopt;
+    if (cached)
+    {
+        spdlog::info("[FILE] Loading model file {} from the scene cache", path);
+        imported.file = std::move(cached->file);
+        imported.scene = std::move(cached->scene);
+    }
+    else
+    {
+        spdlog::info("[FILE] Loading model file {}", path);
+
+        // Kept with the thread, so the importers and post processing steps are only set up once per thread
+        thread_local Assimp::Importer importer {};
+        const aiScene* aiScene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+
+        if (!aiScene || aiScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !aiScene->mRootNode)
+        {
+            spdlog::error("[FILE] Failed to load model file {} with error: {}", path, importer.GetErrorString());
+            return std::nullopt;
+        }
+
+        imported.scene = ImportScene(aiScene, imported.vertices, imported.indices);
+        importer.FreeScene();
+
+        if (sceneCache)
+        {
+            sceneCache->Store(path, imported.scene);
+        }
+    }
+
+    const SceneData& scene = imported.scene;
+    std::shared_ptr<Model> model = std::make_shared<Model>();
+
+    // Process vertex and index data
+    {
+        model->verticesCount = scene.vertices.size();
+        model->indexCount = scene.indices.size();
+
+        // GPU buffers
+        vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+
+        BufferCreation vertexBufferCreation {};
+        vertexBufferCreation.SetName(scene.name + " - Vertex Buffer")
+            .SetUsageFlags(vk::BufferUsageFlagBits::eVertexBuffer | bufferUsage)
+            .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
+            .SetIsMappable(false)
+            .SetSize(sizeof(Model::Vertex) * scene.vertices.size());
+        model->vertexBuffer = std::make_unique<Buffer>(vertexBufferCreation, vulkanContext);
+
+        BufferCreation indexBufferCreation {};
+        indexBufferCreation.SetName(scene.name + " - Index Buffer")
+            .SetUsageFlags(vk::BufferUsageFlagBits::eIndexBuffer | bufferUsage)
+            .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
+            .SetIsMappable(false)
+            .SetSize(sizeof(uint32_t) * scene.indices.size());
+        model->indexBuffer = std::make_unique<Buffer>(indexBufferCreation, vulkanContext);
+
+        // Recorded with the uploads of the other models, submitted once the whole scene is loaded. Cached scenes are
+        // copied straight from the mapped file into the staging ring
+        uploads.UploadBuffer(model->vertexBuffer->buffer, std::as_bytes(scene.vertices));
+        uploads.UploadBuffer(model->indexBuffer->buffer, std::as_bytes(scene.indices));
+    }
+
+    imported.meshBounds = ProcessMeshBounds(scene);
+    imported.emissiveTriangles = ProcessEmissiveTriangles(scene);
+
+    if (vulkanContext->SupportsHostAccelerationStructureCommands())
+    {
+        model->vertices.assign(scene.vertices.begin(), scene.vertices.end());
+        model->indices.assign(scene.indices.begin(), scene.indices.end());
+    }
+
+    imported.model = std::move(model);
+    return imported;
+}
+
 glm::mat4 Node::GetWorldMatrix() const
 {
     glm::mat4 matrix = localMatrix;
@@ -264,99 +559,261 @@ glm::mat4 Node::GetWorldMatrix() const
     return matrix;
 }
 
-ModelLoader::ModelLoader(const std::shared_ptr<BindlessResources>& bindlessResources, const std::shared_ptr<VulkanContext>& vulkanContext)
+ModelLoader::ModelLoader(const std::shared_ptr<BindlessResources>& bindlessResources, const std::shared_ptr<ThreadPool>& threadPool, const std::shared_ptr<VulkanContext>& vulkanContext)
     : _vulkanContext(vulkanContext)
     , _bindlessResources(bindlessResources)
+    , _threadPool(threadPool)
 {
 }
 
-std::shared_ptr<Model> ModelLoader::LoadFromFile(std::string_view path)
+std::vector<std::shared_ptr<Model>> ModelLoader::LoadFromFiles(const std::vector<std::string>& paths)
 {
-    spdlog::info("[FILE] Loading model file {}", path);
+    std::vector<std::future<std::optional<ImportedModel>>> imports {};
+    imports.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        imports.push_back(_threadPool->Submit([path, sceneCache = _sceneCache, vulkanContext = _vulkanContext, resources = _bindlessResources]()
+            { return ImportModel(path, sceneCache, vulkanContext, resources->Uploads()); }));
+    }
+
+    std::vector<std::optional<ImportedModel>> importedModels {};
+    importedModels.reserve(paths.size());
+    for (auto& modelImport : imports)
+    {
+        importedModels.push_back(modelImport.get());
+    }
+
+    // Textures of all models are loaded together, so files shared between them are only read once and all of them decode in parallel
+    std::vector<std::pair<std::string, TextureCompression>> texturePaths {};
+    std::unordered_map<std::string, size_t> texturePathIndices {};
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        if (!importedModels[i])
+        {
+            continue;
+        }
 
-    const aiScene* aiScene = _importer.ReadFile({ path.begin(), path.end() }, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+        const std::string_view directory = ModelDirectory(paths[i]);
+        for (const auto& sceneTexture : importedModels[i]->scene.textures)
+        {
+            const TextureCompression compression = _vulkanContext->SupportsTextureCompressionBC() ? sceneTexture.compression : TextureCompression::eNone;
+            std::string texturePath = TexturePath(directory, sceneTexture.path);
+            const auto [it, inserted] = texturePathIndices.try_emplace(texturePath, texturePaths.size());
+            if (inserted)
+            {
+                texturePaths.emplace_back(std::move(texturePath), compression);
+            }
+            else
+            {
+                texturePaths[it->second].second = std::max(texturePaths[it->second].second, compression);
+            }
+        }
+    }
+    LoadTextures(texturePaths);
 
-    if (!aiScene || aiScene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !aiScene->mRootNode)
+    // Registered in the order of the paths, so resources get the same handles no matter which import finished first
+    std::vector<std::shared_ptr<Model>> models {};
+    models.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i)
     {
-        spdlog::error("[FILE] Failed to load model file {} with error: {}", path, _importer.GetErrorString());
-        return nullptr;
+        models.push_back(importedModels[i] ? CreateModel(importedModels[i].value(), ModelDirectory(paths[i])) : nullptr);
     }
 
-    _imageCache.clear(); // Clear image cache for a new load
-    std::string_view directory = path.substr(0, path.find_last_of('/'));
-    return ProcessModel(aiScene, directory);
+    return models;
 }
 
-std::shared_ptr<Model> ModelLoader::ProcessModel(const aiScene* aiScene, const std::string_view directory)
+void ModelLoader::SetCompressedTextureCacheDirectory(std::string_view directory)
 {
-    std::shared_ptr<Model> model = std::make_shared<Model>();
+    if (directory.empty())
+    {
+        _compressedTextureCache.reset();
+        return;
+    }
 
-    for (uint32_t i = 0; i < aiScene->mNumMaterials; ++i)
+    _compressedTextureCache = std::make_shared<CompressedTextureCache>(directory);
+}
+
+void ModelLoader::SetSceneCacheDirectory(std::string_view directory)
+{
+    if (directory.empty())
     {
-        model->materials.push_back(ProcessMaterial(aiScene->mMaterials[i], directory, _bindlessResources, model->textures, _imageCache));
+        _sceneCache.reset();
+        return;
     }
 
-    std::vector<Model::Vertex> vertices {};
-    std::vector<uint32_t> indices {};
+    _sceneCache = std::make_shared<SceneCache>(directory);
+}
 
-    for (uint32_t i = 0; i < aiScene->mNumMeshes; ++i)
+void ModelLoader::ClearTextureCache()
+{
+    _texturesByPath.clear();
+    _texturesByContent.clear();
+}
+
+void ModelLoader::LoadTextures(const std::vector<std::pair<std::string, TextureCompression>>& paths)
+{
+    // Files that weren't loaded before under the same path are read and hashed first, so copies of loaded textures are never decoded
+    std::vector<std::pair<std::string, TextureCompression>> readPaths {};
+    std::vector<std::future<EncodedImage>> encodedImages {};
+    for (const auto& entry : paths)
     {
-        model->meshes.push_back(ProcessMesh(aiScene, aiScene->mMeshes[i], model->materials, vertices, indices));
+        if (!_texturesByPath.contains(entry.first))
+        {
+            readPaths.push_back(entry);
+            encodedImages.push_back(_threadPool->Submit([path = entry.first]()
+                { return ReadImage(path); }));
+        }
     }
 
-    // Process vertex and index data
+    struct PendingDecode
+    {
+        std::string path;
+        uint64_t contentKey;
+        std::future<TextureData> texture;
+    };
+    std::vector<PendingDecode> decodes {};
+    // Paths with the same content as a texture that is decoded by this load
+    std::vector<std::pair<std::string, uint64_t>> duplicates {};
+
+    for (size_t i = 0; i < readPaths.size(); ++i)
     {
-        std::string sceneName = aiScene->mName.C_Str();
-        model->verticesCount = vertices.size();
-        model->indexCount = indices.size();
-
-        // Staging buffers
-        BufferCreation vertexStagingBufferCreation {};
-        vertexStagingBufferCreation.SetName(sceneName + " - Vertex Staging Buffer")
-            .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
-            .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
-            .SetIsMappable(true)
-            .SetSize(sizeof(Model::Vertex) * vertices.size());
-        Buffer vertexStagingBuffer(vertexStagingBufferCreation, _vulkanContext);
-        memcpy(vertexStagingBuffer.mappedPtr, vertices.data(), sizeof(Model::Vertex) * vertices.size());
-
-        BufferCreation indexStagingBufferCreation {};
-        indexStagingBufferCreation.SetName(sceneName + " - Index Staging Buffer")
-            .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
-            .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
-            .SetIsMappable(true)
-            .SetSize(sizeof(uint32_t) * indices.size());
-        Buffer indexStagingBuffer(indexStagingBufferCreation, _vulkanContext);
-        memcpy(indexStagingBuffer.mappedPtr, indices.data(), sizeof(uint32_t) * indices.size());
+        const std::string& path = readPaths[i].first;
+        const TextureCompression compression = readPaths[i].second;
+        EncodedImage encodedImage = encodedImages[i].get();
+        if (encodedImage.bytes.empty())
+        {
+            spdlog::error("[FILE] Failed to read image from path [{}]", path);
+            continue;
+        }
 
-        // GPU buffers
-        vk::BufferUsageFlags bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress;
+        // The same file compressed in another way is another image
+        const uint64_t contentKey = HashCombine(encodedImage.contentHash, static_cast<uint64_t>(compression));
 
-        BufferCreation vertexBufferCreation {};
-        vertexBufferCreation.SetName(sceneName + " - Vertex Buffer")
-            .SetUsageFlags(vk::BufferUsageFlagBits::eVertexBuffer | bufferUsage)
-            .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
-            .SetIsMappable(false)
-            .SetSize(sizeof(Model::Vertex) * vertices.size());
-        model->vertexBuffer = std::make_unique<Buffer>(vertexBufferCreation, _vulkanContext);
+        const auto it = _texturesByContent.find(contentKey);
+        if (it != _texturesByContent.end())
+        {
+            _texturesByPath.emplace(path, it->second);
+            continue;
+        }
 
-        BufferCreation indexBufferCreation {};
-        indexBufferCreation.SetName(sceneName + " - Index Buffer")
-            .SetUsageFlags(vk::BufferUsageFlagBits::eIndexBuffer | bufferUsage)
-            .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
-            .SetIsMappable(false)
-            .SetSize(sizeof(uint32_t) * indices.size());
-        model->indexBuffer = std::make_unique<Buffer>(indexBufferCreation, _vulkanContext);
+        const auto isSameContent = [&](const PendingDecode& decode)
+        { return decode.contentKey == contentKey; };
+        if (std::any_of(decodes.begin(), decodes.end(), isSameContent))
+        {
+            duplicates.emplace_back(path, contentKey);
+            continue;
+        }
 
-        SingleTimeCommands commands(_vulkanContext);
-        commands.Record([&](vk::CommandBuffer commandBuffer)
-            {
-                VkCopyBufferToBuffer(commandBuffer, vertexStagingBuffer.buffer, model->vertexBuffer->buffer, sizeof(Model::Vertex) * vertices.size());
-                VkCopyBufferToBuffer(commandBuffer, indexStagingBuffer.buffer, model->indexBuffer->buffer, sizeof(uint32_t) * indices.size()); });
-        commands.SubmitAndWait();
+        decodes.push_back(PendingDecode {
+            .path = path,
+            .contentKey = contentKey,
+            .texture = _threadPool->Submit([bytes = std::move(encodedImage.bytes), compression, contentKey, cache = _compressedTextureCache]()
+                { return LoadTextureData(bytes, compression, contentKey, cache); }),
+        });
+    }
+
+    // Images are created on this thread, as the resources aren't synchronized, while later textures still decode
+    uint32_t createdImages = 0;
+    for (auto& decode : decodes)
+    {
+        const TextureData texture = decode.texture.get();
+        if (texture.data.empty())
+        {
+            spdlog::error("[GLTF] Failed to decode image from path [{}]", decode.path);
+            continue;
+        }
+        // Block compressed KTX2 files are only read, never converted
+        if (VkIsBlockCompressed(texture.format) && !_vulkanContext->SupportsTextureCompressionBC())
+        {
+            spdlog::error("[GLTF] Image from path [{}] is {}, which the device can't sample", decode.path, vk::to_string(texture.format));
+            continue;
+        }
+
+        ImageCreation imageCreation {};
+        imageCreation.SetName(std::filesystem::path(decode.path).filename().string())
+            .SetFormat(texture.format)
+            .SetUsageFlags(vk::ImageUsageFlagBits::eSampled)
+            .SetSize(texture.width, texture.height)
+            .SetMipLevels(texture.mipLevels)
+            .SetData(texture.data);
+
+        const ResourceHandle<Image> image = _bindlessResources->Images().Create(imageCreation);
+        _texturesByPath.emplace(decode.path, image);
+        _texturesByContent.emplace(decode.contentKey, image);
+        createdImages++;
     }
 
-    model->nodes = ProcessNodes(aiScene);
+    for (const auto& [path, contentKey] : duplicates)
+    {
+        const auto it = _texturesByContent.find(contentKey);
+        if (it != _texturesByContent.end())
+        {
+            _texturesByPath.emplace(path, it->second);
+        }
+    }
+
+    std::vector<ResourceHandle<Image>> textures {};
+    for (const auto& entry : paths)
+    {
+        const auto it = _texturesByPath.find(entry.first);
+        if (it != _texturesByPath.end() && std::find(textures.begin(), textures.end(), it->second) == textures.end())
+        {
+            textures.push_back(it->second);
+        }
+    }
+
+    spdlog::info("[FILE] Loaded {} textures, {} of them shared with earlier loads or other paths", textures.size(), textures.size() - createdImages);
+}
+
+std::shared_ptr<Model> ModelLoader::CreateModel(ImportedModel& imported, const std::string_view directory)
+{
+    const SceneData& scene = imported.scene;
+    std::shared_ptr<Model> model = std::move(imported.model);
+
+    // Null for the textures that failed to load
+    std::vector<ResourceHandle<Image>> sceneTextures {};
+    sceneTextures.reserve(scene.textures.size());
+    for (const auto& texture : scene.textures)
+    {
+        const auto it = _texturesByPath.find(TexturePath(directory, texture.path));
+        const ResourceHandle<Image> image = it != _texturesByPath.end() ? it->second : ResourceHandle<Image>::Null();
+        sceneTextures.push_back(image);
+        if (!image.IsNull() && std::find(model->textures.begin(), model->textures.end(), image) == model->textures.end())
+        {
+            model->textures.push_back(image);
+        }
+    }
+
+    const auto textureHandle = [&](uint32_t index)
+    { return index < sceneTextures.size() ? sceneTextures[index] : ResourceHandle<Image>::Null(); };
+
+    for (const auto& material : scene.materials)
+    {
+        MaterialCreation materialCreation = material.creation;
+        materialCreation.albedoMap = textureHandle(material.textures[0]);
+        materialCreation.metallicRoughnessMap = textureHandle(material.textures[1]);
+        materialCreation.normalMap = textureHandle(material.textures[2]);
+        materialCreation.occlusionMap = textureHandle(material.textures[3]);
+        materialCreation.emissiveMap = textureHandle(material.textures[4]);
+        model->materials.push_back(_bindlessResources->Materials().Create(materialCreation));
+    }
+
+    for (size_t i = 0; i < scene.meshes.size(); ++i)
+    {
+        const SceneMesh& sceneMesh = scene.meshes[i];
+        Mesh& mesh = model->meshes.emplace_back();
+        mesh.indexCount = sceneMesh.indexCount;
+        mesh.firstIndex = sceneMesh.firstIndex;
+        mesh.firstVertex = sceneMesh.firstVertex;
+        mesh.geometryHash = sceneMesh.geometryHash;
+        if (sceneMesh.material < model->materials.size())
+        {
+            mesh.material = model->materials[sceneMesh.material];
+        }
+        mesh.bounds = imported.meshBounds[i];
+        mesh.emissiveTriangles = std::move(imported.emissiveTriangles[i]);
+    }
 
+    model->nodes = std::move(imported.scene.nodes);
     return model;
 }
@@ -1,49 +1,131 @@
 #include "renderer.hpp"
+#include "acceleration_structure_arena.hpp"
+#include "acceleration_structure_cache.hpp"
+#include "blas_builder.hpp"
+#include "hash.hpp"
 #include "model_loader.hpp"
 #include "resources/bindless_resources.hpp"
 #include "shader.hpp"
 #include "single_time_commands.hpp"
 #include "swap_chain.hpp"
+#include "thread_pool.hpp"
+#include "upload_manager.hpp"
 #include "top_level_acceleration_structure.hpp"
 #include "vulkan_context.hpp"
+#include <filesystem>
+#include <map>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
+#include <spdlog/spdlog.h>
+#include <stb_image_write.h>
+
+PathTracingSettings PathTracingSettings::FromQuality(RenderQuality quality)
+{
+    PathTracingSettings settings {};
+
+    switch (quality)
+    {
+    case RenderQuality::ePreview:
+        settings.samplesPerLaunch = 1;
+        settings.maxDepth = 3;
+        break;
+    case RenderQuality::eReference:
+        settings.samplesPerLaunch = 64;
+        settings.maxDepth = 32;
+        settings.rouletteMinDepth = 5;
+        settings.rouletteMaxSurvival = 0.99f;
+        break;
+    default:
+        break;
+    }
+
+    return settings;
+}
+
+std::optional<RenderQuality> ParseRenderQuality(std::string_view name)
+{
+    if (name == "preview")
+    {
+        return RenderQuality::ePreview;
+    }
+    if (name == "production")
+    {
+        return RenderQuality::eProduction;
+    }
+    if (name == "reference")
+    {
+        return RenderQuality::eReference;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<BLASGranularity> ParseBLASGranularity(std::string_view name)
+{
+    if (name == "mesh")
+    {
+        return BLASGranularity::eMesh;
+    }
+    if (name == "node")
+    {
+        return BLASGranularity::eNode;
+    }
+    if (name == "model")
+    {
+        return BLASGranularity::eModel;
+    }
+
+    return std::nullopt;
+}
 
 Renderer::Renderer(const VulkanInitInfo& initInfo, const std::shared_ptr<VulkanContext>& vulkanContext)
     : _vulkanContext(vulkanContext)
     , _windowWidth(initInfo.width)
     , _windowHeight(initInfo.height)
 {
-    _swapChain = std::make_unique<SwapChain>(vulkanContext, glm::uvec2 { initInfo.width, initInfo.height });
+    if (!_vulkanContext->IsHeadless())
+    {
+        _swapChain = std::make_unique<SwapChain>(vulkanContext, glm::uvec2 { initInfo.width, initInfo.height });
+    }
     InitializeCommandBuffers();
     InitializeSynchronizationObjects();
     InitializeRenderTarget();
+    InitializeConvergenceReadback();
 
-    _bindlessResources = std::make_shared<BindlessResources>(_vulkanContext);
-    _modelLoader = std::make_unique<ModelLoader>(_bindlessResources, _vulkanContext);
-
-    const std::vector<std::string> scene = {
-        "assets/cornell/CornellBox-Original.gltf",
-    };
-    for (const auto& modelPath : scene)
+    // Adaptive sampling is on by default, but every frame has to trace the whole image without indirect launches
+    if (!_vulkanContext->SupportsTraceRaysIndirect())
     {
-        _models.push_back(_modelLoader->LoadFromFile(modelPath));
+        _convergenceThreshold = 0.0f;
     }
-    InitializeBLAS();
 
-    _tlas = std::make_unique<TopLevelAccelerationStructure>(_blases, _bindlessResources, _vulkanContext);
-    _bindlessResources->UpdateDescriptorSet();
+    _bindlessResources = std::make_shared<BindlessResources>(_vulkanContext);
+    _threadPool = std::make_shared<ThreadPool>();
+    _blasCache = std::make_shared<AccelerationStructureCache>(DEFAULT_BLAS_CACHE_DIRECTORY, _vulkanContext);
+    _blasArena = std::make_shared<AccelerationStructureArena>(_vulkanContext->SupportsHostAccelerationStructureCommands(), _vulkanContext);
+    _modelLoader = std::make_unique<ModelLoader>(_bindlessResources, _threadPool, _vulkanContext);
+    _modelLoader->SetCompressedTextureCacheDirectory(DEFAULT_TEXTURE_CACHE_DIRECTORY);
+    _modelLoader->SetSceneCacheDirectory(DEFAULT_SCENE_CACHE_DIRECTORY);
 
     InitializeCamera();
     InitializeDescriptorSets();
     InitializePipeline();
-    InitializeShaderBindingTable();
+    InitializeResolvePipeline();
+    for (auto& pathTracingPipeline : _pipelines)
+    {
+        InitializeShaderBindingTable(pathTracingPipeline);
+    }
 }
 
 Renderer::~Renderer()
 {
-    _vulkanContext->Device().destroyPipeline(_pipeline);
+    _vulkanContext->Device().waitIdle();
+
+    _vulkanContext->Device().destroyPipeline(_resolvePipeline);
+    for (const auto& pathTracingPipeline : _pipelines)
+    {
+        _vulkanContext->Device().destroyPipeline(pathTracingPipeline.pipeline);
+    }
     _vulkanContext->Device().destroyPipelineLayout(_pipelineLayout);
 
     _vulkanContext->Device().destroyDescriptorSetLayout(_descriptorSetLayout);
@@ -57,6 +139,176 @@ Renderer::~Renderer()
     }
 }
 
+bool Renderer::LoadScene(const std::vector<std::string>& scene)
+{
+    if (_tlas && scene == _scene)
+    {
+        spdlog::info("[RENDERER] Scene is already loaded, reusing models and acceleration structures");
+        return true;
+    }
+
+    UnloadScene();
+
+    bool success = true;
+    for (auto& model : _modelLoader->LoadFromFiles(scene))
+    {
+        if (!model)
+        {
+            success = false;
+            continue;
+        }
+
+        _models.push_back(std::move(model));
+    }
+
+    // Geometry and textures of all models go out in as few submissions as the staging ring allows
+    _bindlessResources->Uploads().Flush();
+
+    // A partial scene isn't kept, otherwise requesting the same scene again would reuse it as if it loaded
+    if (!success || _models.empty())
+    {
+        spdlog::error("[RENDERER] Not every model of the scene could be loaded");
+        UnloadScene();
+        return false;
+    }
+
+    InitializeBLAS();
+    UpdateEmissiveTriangles();
+
+    _tlas = std::make_unique<TopLevelAccelerationStructure>(_blases, _tlasInstances, _bindlessResources, _vulkanContext);
+    _bindlessResources->UpdateDescriptorSet();
+    _scene = scene;
+
+    UpdateDescriptorSets();
+    ResetAccumulation();
+
+    return true;
+}
+
+void Renderer::SetCamera(const glm::vec3& position, const glm::vec3& target)
+{
+    _vulkanContext->Device().waitIdle();
+
+    _cameraPosition = position;
+    _cameraTarget = target;
+    UpdateCamera();
+    ResetAccumulation();
+}
+
+void Renderer::SetInstanceTransform(uint32_t instanceIndex, const glm::mat4& transform)
+{
+    if (instanceIndex >= _tlasInstances.size())
+    {
+        spdlog::error("[RENDERER] Instance {} is out of range, the scene has {} instances", instanceIndex, _tlasInstances.size());
+        return;
+    }
+
+    _tlasInstances[instanceIndex].transform = transform;
+    _instancesDirty = true;
+
+    // The lights are sampled in world space, so they move with the instance
+    if (!_instanceEmissiveTriangles[instanceIndex].empty())
+    {
+        _vulkanContext->Device().waitIdle();
+
+        UpdateEmissiveTriangles();
+        _bindlessResources->UploadEmissiveTriangles();
+    }
+
+    ResetAccumulation();
+}
+
+void Renderer::SetQuality(RenderQuality quality)
+{
+    if (quality == _quality)
+    {
+        return;
+    }
+
+    _quality = quality;
+    ResetAccumulation();
+}
+
+void Renderer::SetBLASGranularity(BLASGranularity granularity)
+{
+    if (granularity == _blasGranularity)
+    {
+        return;
+    }
+
+    _blasGranularity = granularity;
+    // Forces the next LoadScene to rebuild, even for the same scene
+    _scene.clear();
+}
+
+void Renderer::SetBLASCacheDirectory(std::string_view directory)
+{
+    if (directory.empty())
+    {
+        _blasCache.reset();
+        return;
+    }
+
+    _blasCache = std::make_shared<AccelerationStructureCache>(directory, _vulkanContext);
+}
+
+void Renderer::SetTextureCacheDirectory(std::string_view directory)
+{
+    _modelLoader->SetCompressedTextureCacheDirectory(directory);
+}
+
+void Renderer::SetSceneCacheDirectory(std::string_view directory)
+{
+    _modelLoader->SetSceneCacheDirectory(directory);
+}
+
+void Renderer::SetConvergenceThreshold(float threshold)
+{
+    // The adaptive sampling launches only the unconverged tiles, with the launch size written on the GPU
+    if (threshold > 0.0f && !_vulkanContext->SupportsTraceRaysIndirect())
+    {
+        spdlog::warn("[RENDERER] Adaptive sampling requires indirect ray tracing launches, which the device doesn't support");
+        threshold = 0.0f;
+    }
+
+    threshold = std::max(threshold, 0.0f);
+    if (threshold == _convergenceThreshold)
+    {
+        return;
+    }
+
+    _convergenceThreshold = threshold;
+    ResetAccumulation();
+}
+
+bool Renderer::IsConverged() const
+{
+    return _convergenceThreshold > 0.0f && _unconvergedPixels.has_value() && _unconvergedPixels.value() == 0;
+}
+
+void Renderer::Resize(uint32_t width, uint32_t height)
+{
+    if (width == _windowWidth && height == _windowHeight)
+    {
+        return;
+    }
+
+    if (_swapChain)
+    {
+        spdlog::error("[RENDERER] Resizing is only supported when rendering headless");
+        return;
+    }
+
+    _vulkanContext->Device().waitIdle();
+
+    _windowWidth = width;
+    _windowHeight = height;
+    InitializeRenderTarget();
+    UpdateCamera();
+    UpdateDescriptorSets();
+    ResetAccumulation();
+}
+
 void Renderer::Render()
 {
     uint32_t currentResourcesFrame = _renderedFrames % MAX_FRAMES_IN_FLIGHT;
@@ -65,10 +317,15 @@ void Renderer::Render()
                       std::numeric_limits<uint64_t>::max()),
         "[VULKAN] Failed waiting on in flight fence!");
 
+    ReadConvergenceStatistics(currentResourcesFrame);
+
     uint32_t swapChainImageIndex {};
-    VkCheckResult(_vulkanContext->Device().acquireNextImageKHR(_swapChain->GetSwapChain(), std::numeric_limits<uint64_t>::max(),
-                      _imageAvailableSemaphores.at(currentResourcesFrame), nullptr, &swapChainImageIndex),
-        "[VULKAN] Failed to acquire swap chain image!");
+    if (_swapChain)
+    {
+        VkCheckResult(_vulkanContext->Device().acquireNextImageKHR(_swapChain->GetSwapChain(), std::numeric_limits<uint64_t>::max(),
+                          _imageAvailableSemaphores.at(currentResourcesFrame), nullptr, &swapChainImageIndex),
+            "[VULKAN] Failed to acquire swap chain image!");
+    }
 
     VkCheckResult(_vulkanContext->Device().resetFences(1, &_inFlightFences.at(currentResourcesFrame)), "[VULKAN] Failed resetting fences!");
 
@@ -80,51 +337,265 @@ void Renderer::Render()
     RecordCommands(commandBuffer, swapChainImageIndex);
     commandBuffer.end();
 
-    vk::Semaphore waitSemaphore = _imageAvailableSemaphores.at(currentResourcesFrame);
-    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    vk::Semaphore signalSemaphore = _renderFinishedSemaphores.at(currentResourcesFrame);
+    std::vector<vk::SemaphoreSubmitInfo> waitSemaphores {};
+    std::vector<vk::SemaphoreSubmitInfo> signalSemaphores {};
 
-    vk::SubmitInfo submitInfo {};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &waitSemaphore;
-    submitInfo.pWaitDstStageMask = &waitStage;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &signalSemaphore;
-    VkCheckResult(_vulkanContext->GraphicsQueue().submit(1, &submitInfo, _inFlightFences.at(currentResourcesFrame)), "[VULKAN] Failed submitting to graphics queue!");
+    // Without a swap chain there is nothing to wait on or to present
+    if (_swapChain)
+    {
+        vk::SemaphoreSubmitInfo& imageAvailable = waitSemaphores.emplace_back();
+        imageAvailable.semaphore = _imageAvailableSemaphores.at(currentResourcesFrame);
+        imageAvailable.stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput;
+
+        vk::SemaphoreSubmitInfo& renderFinished = signalSemaphores.emplace_back();
+        renderFinished.semaphore = _renderFinishedSemaphores.at(currentResourcesFrame);
+        renderFinished.stageMask = vk::PipelineStageFlagBits2::eAllCommands;
+    }
+
+    // Uploads and builds submitted to the other queues before this frame have to be done before it reads their results
+    for (const QueueType queueType : { QueueType::eCompute, QueueType::eTransfer })
+    {
+        if (_vulkanContext->TimelineValue(queueType) == 0)
+        {
+            continue;
+        }
+
+        vk::SemaphoreSubmitInfo& timeline = waitSemaphores.emplace_back();
+        timeline.semaphore = _vulkanContext->Timeline(queueType);
+        timeline.value = _vulkanContext->TimelineValue(queueType);
+        timeline.stageMask = vk::PipelineStageFlagBits2::eAllCommands;
+    }
+
+    vk::CommandBufferSubmitInfo commandBufferInfo {};
+    commandBufferInfo.commandBuffer = commandBuffer;
+
+    vk::SubmitInfo2 submitInfo {};
+    submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphoreInfos = waitSemaphores.data();
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphoreInfos = signalSemaphores.data();
+    VkCheckResult(_vulkanContext->GraphicsQueue().submit2(1, &submitInfo, _inFlightFences.at(currentResourcesFrame)), "[VULKAN] Failed submitting to graphics queue!");
+
+    if (!_swapChain)
+    {
+        _renderedFrames++;
+        _accumulatedFrames++;
+        return;
+    }
 
     vk::SwapchainKHR swapchain = _swapChain->GetSwapChain();
     vk::PresentInfoKHR presentInfo {};
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &signalSemaphore;
+    presentInfo.pWaitSemaphores = &_renderFinishedSemaphores.at(currentResourcesFrame);
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapchain;
     presentInfo.pImageIndices = &swapChainImageIndex;
     VkCheckResult(_vulkanContext->PresentQueue().presentKHR(&presentInfo), "[VULKAN] Failed to present swap chain image!");
 
     _renderedFrames++;
+    _accumulatedFrames++;
+}
+
+void Renderer::RenderOffscreen(uint32_t sampleBudget)
+{
+    const uint32_t samplesPerFrame = _pipelines.at(static_cast<size_t>(_quality)).settings.samplesPerLaunch;
+    const uint32_t frameCount = (sampleBudget + samplesPerFrame - 1) / samplesPerFrame;
+    spdlog::info("[RENDERER] Rendering {} frames offscreen for {} samples per pixel", frameCount, frameCount * samplesPerFrame);
+
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        if (IsConverged())
+        {
+            spdlog::info("[RENDERER] All pixels converged after {} of {} frames", _accumulatedFrames, frameCount);
+            break;
+        }
+
+        Render();
+    }
+
+    _vulkanContext->Device().waitIdle();
+}
+
+bool Renderer::SaveRenderTarget(std::string_view path)
+{
+    _vulkanContext->Device().waitIdle();
+
+    const std::string filePath { path };
+    const std::string extension = std::filesystem::path(filePath).extension().string();
+    const int32_t width = static_cast<int32_t>(_windowWidth);
+    const int32_t height = static_cast<int32_t>(_windowHeight);
+    const size_t pixelCount = static_cast<size_t>(_windowWidth) * _windowHeight;
+
+    int32_t result = 0;
+    if (extension == ".hdr")
+    {
+        const std::vector<std::byte> accumulation = ReadbackImage(*_accumulationTarget, vk::ImageLayout::eGeneral, pixelCount * sizeof(glm::vec4));
+        const auto* sums = reinterpret_cast<const glm::vec4*>(accumulation.data());
+
+        std::vector<float> radiance(pixelCount * 3);
+        for (size_t i = 0; i < pixelCount; ++i)
+        {
+            const glm::vec3 average = glm::vec3(sums[i]) / std::max(sums[i].w, 1.0f);
+            radiance[i * 3 + 0] = average.r;
+            radiance[i * 3 + 1] = average.g;
+            radiance[i * 3 + 2] = average.b;
+        }
+
+        result = stbi_write_hdr(filePath.c_str(), width, height, 3, radiance.data());
+    }
+    else
+    {
+        // The render target is left as a transfer source after resolving
+        const std::vector<std::byte> pixels = ReadbackImage(*_renderTarget, vk::ImageLayout::eTransferSrcOptimal, pixelCount * 4);
+
+        if (extension == ".png")
+        {
+            result = stbi_write_png(filePath.c_str(), width, height, 4, pixels.data(), width * 4);
+        }
+        else if (extension == ".jpg" || extension == ".jpeg")
+        {
+            result = stbi_write_jpg(filePath.c_str(), width, height, 4, pixels.data(), 95);
+        }
+        else if (extension == ".bmp")
+        {
+            result = stbi_write_bmp(filePath.c_str(), width, height, 4, pixels.data());
+        }
+        else if (extension == ".tga")
+        {
+            result = stbi_write_tga(filePath.c_str(), width, height, 4, pixels.data());
+        }
+        else
+        {
+            spdlog::error("[FILE] Unsupported image extension \"{}\" for render output {}", extension, path);
+            return false;
+        }
+    }
+
+    if (result == 0)
+    {
+        spdlog::error("[FILE] Failed writing render output to {}", path);
+        return false;
+    }
+
+    spdlog::info("[FILE] Saved render output to {}", path);
+    return true;
+}
+
+std::vector<std::byte> Renderer::ReadbackImage(const Image& image, vk::ImageLayout currentLayout, vk::DeviceSize size)
+{
+    BufferCreation readbackBufferCreation {};
+    readbackBufferCreation.SetName("Render Target Readback Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eTransferDst)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_TO_CPU)
+        .SetIsMappable(true)
+        .SetSize(size);
+    Buffer readbackBuffer(readbackBufferCreation, _vulkanContext);
+
+    SingleTimeCommands commands(_vulkanContext);
+    commands.Record([&](vk::CommandBuffer commandBuffer)
+        {
+            if (currentLayout != vk::ImageLayout::eTransferSrcOptimal)
+            {
+                VkTransitionImageLayout(commandBuffer, image.image, image.format, currentLayout, vk::ImageLayout::eTransferSrcOptimal);
+            }
+            VkCopyImageToBuffer(commandBuffer, image.image, readbackBuffer.buffer, _windowWidth, _windowHeight);
+            if (currentLayout != vk::ImageLayout::eTransferSrcOptimal)
+            {
+                VkTransitionImageLayout(commandBuffer, image.image, image.format, vk::ImageLayout::eTransferSrcOptimal, currentLayout);
+            } });
+    commands.SubmitAndWait();
+
+    VkCheckResult(vmaInvalidateAllocation(_vulkanContext->MemoryAllocator(), readbackBuffer.allocation, 0, size), "[VULKAN] Failed invalidating readback buffer!");
+
+    std::vector<std::byte> data(size);
+    std::memcpy(data.data(), readbackBuffer.mappedPtr, size);
+    return data;
 }
 
 void Renderer::RecordCommands(const vk::CommandBuffer& commandBuffer, uint32_t swapChainImageIndex)
 {
-    VkTransitionImageLayout(commandBuffer, _renderTarget->image, _renderTarget->format,
-        vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+    const ImageLayoutTransitionState rayTracingState { vk::PipelineStageFlagBits2::eRayTracingShaderKHR, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite };
+    const ImageLayoutTransitionState resolveReadState { vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead };
+    const ImageLayoutTransitionState resolveWriteState { vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite };
+
+    const ImageLayoutTransitionState tileListWriteState { vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite };
+    const ImageLayoutTransitionState tileListReadState { vk::PipelineStageFlagBits2::eRayTracingShaderKHR | vk::PipelineStageFlagBits2::eDrawIndirect,
+        vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eIndirectCommandRead };
+    const ImageLayoutTransitionState transferWriteState { vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite };
+    const ImageLayoutTransitionState transferReadState { vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead };
+
+    const uint32_t currentResourcesFrame = _renderedFrames % MAX_FRAMES_IN_FLIGHT;
 
-    commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, _pipeline);
+    if (_instancesDirty)
+    {
+        _tlas->Update(commandBuffer, currentResourcesFrame, _tlasInstances);
+        _instancesDirty = false;
+    }
+
+    // The resolve pass of the previous frame has to finish reading the accumulation and writing the tile list before they are used again
+    VkGlobalMemoryBarrier(commandBuffer, tileListWriteState, tileListReadState);
+
+    const PathTracingPipeline& pathTracingPipeline = _pipelines.at(static_cast<size_t>(_quality));
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eRayTracingKHR, pathTracingPipeline.pipeline);
     commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, _pipelineLayout, 0, _bindlessResources->DescriptorSet(), nullptr);
     commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eRayTracingKHR, _pipelineLayout, 1, _descriptorSet, nullptr);
 
-    PushConstantData pushConstants { _renderedFrames };
-    commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(PushConstantData), &pushConstants);
+    // Every pixel is traced until the variance estimates can be trusted, after which only the tiles the resolve pass left behind are
+    const bool adaptive = _convergenceThreshold > 0.0f && _accumulatedFrames >= ADAPTIVE_MIN_FRAMES;
+
+    PushConstantData pushConstants {};
+    pushConstants.frameIndex = _accumulatedFrames;
+    pushConstants.adaptive = adaptive;
+    pushConstants.convergenceThreshold = _convergenceThreshold > 0.0f ? _convergenceThreshold : std::numeric_limits<float>::max();
+    pushConstants.adaptiveMinFrames = ADAPTIVE_MIN_FRAMES;
+    commandBuffer.pushConstants(_pipelineLayout, vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstantData), &pushConstants);
 
     vk::StridedDeviceAddressRegionKHR callableShaderSbtEntry {};
-    commandBuffer.traceRaysKHR(_raygenAddressRegion, _missAddressRegion, _hitAddressRegion, callableShaderSbtEntry, _windowWidth, _windowHeight, 1, _vulkanContext->Dldi());
+    if (adaptive)
+    {
+        const vk::DeviceAddress indirectCommandAddress = _vulkanContext->GetBufferDeviceAddress(_adaptiveTileBuffer->buffer);
+        commandBuffer.traceRaysIndirectKHR(pathTracingPipeline.raygenAddressRegion, pathTracingPipeline.missAddressRegion, pathTracingPipeline.hitAddressRegion, callableShaderSbtEntry, indirectCommandAddress, _vulkanContext->Dldi());
+    }
+    else
+    {
+        commandBuffer.traceRaysKHR(pathTracingPipeline.raygenAddressRegion, pathTracingPipeline.missAddressRegion, pathTracingPipeline.hitAddressRegion, callableShaderSbtEntry, _windowWidth, _windowHeight, 1, _vulkanContext->Dldi());
+    }
+
+    // The resolve pass rebuilds the tile list from scratch, starting with one launch row per tile and no tiles yet
+    VkGlobalMemoryBarrier(commandBuffer, tileListReadState, transferWriteState);
+    AdaptiveTilesHeader header {};
+    header.command.width = ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE;
+    header.command.height = 0;
+    header.command.depth = 1;
+    commandBuffer.updateBuffer(_adaptiveTileBuffer->buffer, 0, sizeof(AdaptiveTilesHeader), &header);
+
+    VkGlobalMemoryBarrier(commandBuffer, rayTracingState, resolveReadState);
+    VkGlobalMemoryBarrier(commandBuffer, transferWriteState, tileListWriteState);
+    VkImageBarrier(commandBuffer, _renderTarget->image, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+        { vk::PipelineStageFlagBits2::eTopOfPipe, vk::AccessFlags2 { 0 } }, resolveWriteState);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, _resolvePipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipelineLayout, 1, _descriptorSet, nullptr);
+    commandBuffer.dispatch((_windowWidth + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, (_windowHeight + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE, 1);
+
+    VkImageBarrier(commandBuffer, _renderTarget->image, vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal,
+        resolveWriteState, transferReadState);
+
+    // The amount of unconverged pixels is read on the CPU once the fence of this frame is waited on again
+    VkGlobalMemoryBarrier(commandBuffer, tileListWriteState, transferReadState);
+    vk::BufferCopy headerCopy { 0, 0, sizeof(AdaptiveTilesHeader) };
+    commandBuffer.copyBuffer(_adaptiveTileBuffer->buffer, _convergenceReadbackBuffers.at(currentResourcesFrame)->buffer, 1, &headerCopy);
+    _convergenceReadbackFrames.at(currentResourcesFrame) = _accumulatedFrames + 1;
+
+    if (!_swapChain)
+    {
+        return;
+    }
 
     VkTransitionImageLayout(commandBuffer, _swapChain->GetImage(swapChainImageIndex), _swapChain->GetFormat(),
         vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-    VkTransitionImageLayout(commandBuffer, _renderTarget->image, _renderTarget->format,
-        vk::ImageLayout::eGeneral, vk::ImageLayout::eTransferSrcOptimal);
 
     vk::Extent2D extent = { _windowWidth, _windowHeight };
     VkCopyImageToImage(commandBuffer, _renderTarget->image, _swapChain->GetImage(swapChainImageIndex), extent, extent);
@@ -161,26 +632,82 @@ void Renderer::InitializeSynchronizationObjects()
 void Renderer::InitializeRenderTarget()
 {
     ImageCreation imageCreation {};
-    imageCreation.SetName("Render Target")
+    imageCreation.SetName("Accumulation Target")
         .SetSize(_windowWidth, _windowHeight)
-        .SetFormat(_swapChain->GetFormat())
+        .SetFormat(vk::Format::eR32G32B32A32Sfloat)
         .SetUsageFlags(vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eStorage);
 
+    _accumulationTarget = std::make_unique<Image>(imageCreation, _vulkanContext);
+
+    // The blit to the swap chain takes care of converting to its format
+    imageCreation.SetName("Render Target")
+        .SetFormat(vk::Format::eR8G8B8A8Unorm);
+
     _renderTarget = std::make_unique<Image>(imageCreation, _vulkanContext);
+
+    imageCreation.SetName("Moment Target")
+        .SetFormat(vk::Format::eR32Sfloat)
+        .SetUsageFlags(vk::ImageUsageFlagBits::eStorage);
+
+    _momentTarget = std::make_unique<Image>(imageCreation, _vulkanContext);
+
+    const uint32_t tileCount = ((_windowWidth + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE) * ((_windowHeight + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE);
+
+    BufferCreation tileBufferCreation {};
+    tileBufferCreation.SetName("Adaptive Tile Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress
+            | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
+        .SetIsMappable(false)
+        .SetSize(sizeof(AdaptiveTilesHeader) + tileCount * sizeof(uint32_t));
+    _adaptiveTileBuffer = std::make_unique<Buffer>(tileBufferCreation, _vulkanContext);
+
+    // The accumulation and moments are read back in later frames, so they stay in the general layout instead of being discarded every frame
+    SingleTimeCommands commands(_vulkanContext);
+    commands.Record([&](vk::CommandBuffer commandBuffer)
+        {
+            VkTransitionImageLayout(commandBuffer, _accumulationTarget->image, _accumulationTarget->format, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+            VkTransitionImageLayout(commandBuffer, _momentTarget->image, _momentTarget->format, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral); });
+    commands.SubmitAndWait();
 }
 
-void Renderer::InitializeCamera()
+void Renderer::InitializeConvergenceReadback()
 {
-    constexpr float fov = glm::radians(60.0f);
-    const float aspectRatio = _windowWidth / static_cast<float>(_windowHeight);
+    BufferCreation readbackBufferCreation {};
+    readbackBufferCreation.SetName("Convergence Readback Buffer")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eTransferDst)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_TO_CPU)
+        .SetIsMappable(true)
+        .SetSize(sizeof(AdaptiveTilesHeader));
 
-    glm::mat4 projection = glm::perspectiveRH_ZO(fov, aspectRatio, 0.1f, 1000.0f);
-    projection[1][1] *= -1; // Inverting Y for Vulkan (not needed with perspectiveVK)
+    for (auto& readbackBuffer : _convergenceReadbackBuffers)
+    {
+        readbackBuffer = std::make_unique<Buffer>(readbackBufferCreation, _vulkanContext);
+    }
+}
 
-    CameraUniformData cameraData {};
-    cameraData.projInverse = glm::inverse(projection);
-    cameraData.viewInverse = glm::inverse(glm::lookAt(glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+void Renderer::ReadConvergenceStatistics(uint32_t resourcesFrame)
+{
+    // Statistics recorded before the accumulation was last reset describe an image that no longer exists
+    const uint32_t recordedFrame = _convergenceReadbackFrames.at(resourcesFrame);
+    if (recordedFrame == 0)
+    {
+        return;
+    }
 
+    const Buffer& readbackBuffer = *_convergenceReadbackBuffers.at(resourcesFrame);
+    VkCheckResult(vmaInvalidateAllocation(_vulkanContext->MemoryAllocator(), readbackBuffer.allocation, 0, sizeof(AdaptiveTilesHeader)), "[VULKAN] Failed invalidating convergence readback buffer!");
+
+    AdaptiveTilesHeader header {};
+    std::memcpy(&header, readbackBuffer.mappedPtr, sizeof(AdaptiveTilesHeader));
+
+    // Pixels below the minimum amount of frames always count as unconverged, so early frames can't report convergence
+    _unconvergedPixels = header.unconvergedPixels;
+    _convergenceReadbackFrames.at(resourcesFrame) = 0;
+}
+
+void Renderer::InitializeCamera()
+{
     constexpr vk::DeviceSize uniformBufferSize = sizeof(CameraUniformData);
     BufferCreation uniformBufferCreation {};
     uniformBufferCreation.SetName("Camera Uniform Buffer")
@@ -189,24 +716,40 @@ void Renderer::InitializeCamera()
         .SetIsMappable(true)
         .SetSize(uniformBufferSize);
     _uniformBuffer = std::make_unique<Buffer>(uniformBufferCreation, _vulkanContext);
-    memcpy(_uniformBuffer->mappedPtr, &cameraData, uniformBufferSize);
+
+    UpdateCamera();
+}
+
+void Renderer::UpdateCamera()
+{
+    constexpr float fov = glm::radians(60.0f);
+    const float aspectRatio = _windowWidth / static_cast<float>(_windowHeight);
+
+    glm::mat4 projection = glm::perspectiveRH_ZO(fov, aspectRatio, 0.1f, 1000.0f);
+    projection[1][1] *= -1; // Inverting Y for Vulkan (not needed with perspectiveVK)
+
+    CameraUniformData cameraData {};
+    cameraData.projInverse = glm::inverse(projection);
+    cameraData.viewInverse = glm::inverse(glm::lookAt(_cameraPosition, _cameraTarget, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    memcpy(_uniformBuffer->mappedPtr, &cameraData, sizeof(CameraUniformData));
 }
 
 void Renderer::InitializeDescriptorSets()
 {
-    std::array<vk::DescriptorSetLayoutBinding, 3> bindingLayouts {};
+    std::array<vk::DescriptorSetLayoutBinding, 6> bindingLayouts {};
 
     vk::DescriptorSetLayoutBinding& imageLayout = bindingLayouts.at(0);
     imageLayout.binding = 0;
     imageLayout.descriptorType = vk::DescriptorType::eStorageImage;
     imageLayout.descriptorCount = 1;
-    imageLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR;
+    imageLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eCompute;
 
     vk::DescriptorSetLayoutBinding& accelerationStructureLayout = bindingLayouts.at(1);
     accelerationStructureLayout.binding = 1;
     accelerationStructureLayout.descriptorType = vk::DescriptorType::eAccelerationStructureKHR;
     accelerationStructureLayout.descriptorCount = 1;
-    accelerationStructureLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR;
+    accelerationStructureLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR;
 
     vk::DescriptorSetLayoutBinding& cameraLayout = bindingLayouts.at(2);
     cameraLayout.binding = 2;
@@ -214,16 +757,34 @@ void Renderer::InitializeDescriptorSets()
     cameraLayout.descriptorCount = 1;
     cameraLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR;
 
+    vk::DescriptorSetLayoutBinding& displayImageLayout = bindingLayouts.at(3);
+    displayImageLayout.binding = 3;
+    displayImageLayout.descriptorType = vk::DescriptorType::eStorageImage;
+    displayImageLayout.descriptorCount = 1;
+    displayImageLayout.stageFlags = vk::ShaderStageFlagBits::eCompute;
+
+    vk::DescriptorSetLayoutBinding& momentImageLayout = bindingLayouts.at(4);
+    momentImageLayout.binding = 4;
+    momentImageLayout.descriptorType = vk::DescriptorType::eStorageImage;
+    momentImageLayout.descriptorCount = 1;
+    momentImageLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eCompute;
+
+    vk::DescriptorSetLayoutBinding& tileBufferLayout = bindingLayouts.at(5);
+    tileBufferLayout.binding = 5;
+    tileBufferLayout.descriptorType = vk::DescriptorType::eStorageBuffer;
+    tileBufferLayout.descriptorCount = 1;
+    tileBufferLayout.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eCompute;
+
     vk::DescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo {};
     descriptorSetLayoutCreateInfo.bindingCount = bindingLayouts.size();
     descriptorSetLayoutCreateInfo.pBindings = bindingLayouts.data();
     _descriptorSetLayout = _vulkanContext->Device().createDescriptorSetLayout(descriptorSetLayoutCreateInfo);
 
-    std::array<vk::DescriptorPoolSize, 3> poolSizes {};
+    std::array<vk::DescriptorPoolSize, 4> poolSizes {};
 
     vk::DescriptorPoolSize& imagePoolSize = poolSizes.at(0);
     imagePoolSize.type = vk::DescriptorType::eStorageImage;
-    imagePoolSize.descriptorCount = 1;
+    imagePoolSize.descriptorCount = 3;
 
     vk::DescriptorPoolSize& accelerationStructureSize = poolSizes.at(1);
     accelerationStructureSize.type = vk::DescriptorType::eAccelerationStructureKHR;
@@ -233,6 +794,10 @@ void Renderer::InitializeDescriptorSets()
     cameraSize.type = vk::DescriptorType::eUniformBuffer;
     cameraSize.descriptorCount = 1;
 
+    vk::DescriptorPoolSize& tileBufferSize = poolSizes.at(3);
+    tileBufferSize.type = vk::DescriptorType::eStorageBuffer;
+    tileBufferSize.descriptorCount = 1;
+
     vk::DescriptorPoolCreateInfo descriptorPoolCreateInfo {};
     descriptorPoolCreateInfo.maxSets = 1;
     descriptorPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
@@ -244,11 +809,32 @@ void Renderer::InitializeDescriptorSets()
     descriptorSetAllocateInfo.descriptorSetCount = 1;
     descriptorSetAllocateInfo.pSetLayouts = &_descriptorSetLayout;
     _descriptorSet = _vulkanContext->Device().allocateDescriptorSets(descriptorSetAllocateInfo).front();
+}
+
+void Renderer::UpdateDescriptorSets()
+{
+    if (!_tlas)
+    {
+        return;
+    }
 
     vk::DescriptorImageInfo descriptorImageInfo {};
-    descriptorImageInfo.imageView = _renderTarget->view;
+    descriptorImageInfo.imageView = _accumulationTarget->view;
     descriptorImageInfo.imageLayout = vk::ImageLayout::eGeneral;
 
+    vk::DescriptorImageInfo displayImageInfo {};
+    displayImageInfo.imageView = _renderTarget->view;
+    displayImageInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+    vk::DescriptorImageInfo momentImageInfo {};
+    momentImageInfo.imageView = _momentTarget->view;
+    momentImageInfo.imageLayout = vk::ImageLayout::eGeneral;
+
+    vk::DescriptorBufferInfo tileBufferInfo {};
+    tileBufferInfo.buffer = _adaptiveTileBuffer->buffer;
+    tileBufferInfo.offset = 0;
+    tileBufferInfo.range = vk::WholeSize;
+
     vk::WriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo {};
     descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
     const vk::AccelerationStructureKHR tlas = _tlas->Structure();
@@ -259,7 +845,7 @@ void Renderer::InitializeDescriptorSets()
     descriptorBufferInfo.offset = 0;
     descriptorBufferInfo.range = sizeof(CameraUniformData);
 
-    std::array<vk::WriteDescriptorSet, 3> descriptorWrites {};
+    std::array<vk::WriteDescriptorSet, 6> descriptorWrites {};
 
     vk::WriteDescriptorSet& imageWrite = descriptorWrites.at(0);
     imageWrite.dstSet = _descriptorSet;
@@ -285,6 +871,30 @@ void Renderer::InitializeDescriptorSets()
     uniformBufferWrite.descriptorType = vk::DescriptorType::eUniformBuffer;
     uniformBufferWrite.pBufferInfo = &descriptorBufferInfo;
 
+    vk::WriteDescriptorSet& displayImageWrite = descriptorWrites.at(3);
+    displayImageWrite.dstSet = _descriptorSet;
+    displayImageWrite.dstBinding = 3;
+    displayImageWrite.dstArrayElement = 0;
+    displayImageWrite.descriptorCount = 1;
+    displayImageWrite.descriptorType = vk::DescriptorType::eStorageImage;
+    displayImageWrite.pImageInfo = &displayImageInfo;
+
+    vk::WriteDescriptorSet& momentImageWrite = descriptorWrites.at(4);
+    momentImageWrite.dstSet = _descriptorSet;
+    momentImageWrite.dstBinding = 4;
+    momentImageWrite.dstArrayElement = 0;
+    momentImageWrite.descriptorCount = 1;
+    momentImageWrite.descriptorType = vk::DescriptorType::eStorageImage;
+    momentImageWrite.pImageInfo = &momentImageInfo;
+
+    vk::WriteDescriptorSet& tileBufferWrite = descriptorWrites.at(5);
+    tileBufferWrite.dstSet = _descriptorSet;
+    tileBufferWrite.dstBinding = 5;
+    tileBufferWrite.dstArrayElement = 0;
+    tileBufferWrite.descriptorCount = 1;
+    tileBufferWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+    tileBufferWrite.pBufferInfo = &tileBufferInfo;
+
     _vulkanContext->Device().updateDescriptorSets(static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
@@ -292,9 +902,10 @@ void Renderer::InitializePipeline()
 {
     vk::ShaderModule raygenModule = Shader::CreateShaderModule("shaders/bin/ray_gen.rgen.spv", _vulkanContext->Device());
     vk::ShaderModule missModule = Shader::CreateShaderModule("shaders/bin/miss.rmiss.spv", _vulkanContext->Device());
+    vk::ShaderModule shadowMissModule = Shader::CreateShaderModule("shaders/bin/shadow.rmiss.spv", _vulkanContext->Device());
     vk::ShaderModule chitModule = Shader::CreateShaderModule("shaders/bin/closest_hit.rchit.spv", _vulkanContext->Device());
 
-    std::array<vk::PipelineShaderStageCreateInfo, 3> shaderStagesCreateInfo {};
+    std::array<vk::PipelineShaderStageCreateInfo, 4> shaderStagesCreateInfo {};
 
     vk::PipelineShaderStageCreateInfo& raygenStage = shaderStagesCreateInfo.at(0);
     raygenStage.stage = vk::ShaderStageFlagBits::eRaygenKHR;
@@ -306,12 +917,17 @@ void Renderer::InitializePipeline()
     missStage.module = missModule;
     missStage.pName = "main";
 
-    vk::PipelineShaderStageCreateInfo& chitStage = shaderStagesCreateInfo.at(2);
+    vk::PipelineShaderStageCreateInfo& shadowMissStage = shaderStagesCreateInfo.at(2);
+    shadowMissStage.stage = vk::ShaderStageFlagBits::eMissKHR;
+    shadowMissStage.module = shadowMissModule;
+    shadowMissStage.pName = "main";
+
+    vk::PipelineShaderStageCreateInfo& chitStage = shaderStagesCreateInfo.at(3);
     chitStage.stage = vk::ShaderStageFlagBits::eClosestHitKHR;
     chitStage.module = chitModule;
     chitStage.pName = "main";
 
-    std::array<vk::RayTracingShaderGroupCreateInfoKHR, 3> shaderGroupsCreateInfo {};
+    std::array<vk::RayTracingShaderGroupCreateInfoKHR, 4> shaderGroupsCreateInfo {};
 
     vk::RayTracingShaderGroupCreateInfoKHR& group1 = shaderGroupsCreateInfo.at(0);
     group1.type = vk::RayTracingShaderGroupTypeKHR::eGeneral;
@@ -327,19 +943,27 @@ void Renderer::InitializePipeline()
     group2.anyHitShader = vk::ShaderUnusedKHR;
     group2.intersectionShader = vk::ShaderUnusedKHR;
 
+    // Miss index 1, used by the shadow rays of the light sampling
     vk::RayTracingShaderGroupCreateInfoKHR& group3 = shaderGroupsCreateInfo.at(2);
-    group3.type = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup;
-    group3.generalShader = vk::ShaderUnusedKHR;
-    group3.closestHitShader = 2;
+    group3.type = vk::RayTracingShaderGroupTypeKHR::eGeneral;
+    group3.generalShader = 2;
+    group3.closestHitShader = vk::ShaderUnusedKHR;
     group3.anyHitShader = vk::ShaderUnusedKHR;
     group3.intersectionShader = vk::ShaderUnusedKHR;
 
+    vk::RayTracingShaderGroupCreateInfoKHR& group4 = shaderGroupsCreateInfo.at(3);
+    group4.type = vk::RayTracingShaderGroupTypeKHR::eTrianglesHitGroup;
+    group4.generalShader = vk::ShaderUnusedKHR;
+    group4.closestHitShader = 3;
+    group4.anyHitShader = vk::ShaderUnusedKHR;
+    group4.intersectionShader = vk::ShaderUnusedKHR;
+
     std::array<vk::DescriptorSetLayout, 2> descriptorSetLayouts { _bindlessResources->DescriptorSetLayout(), _descriptorSetLayout };
 
     vk::PushConstantRange pushConstantRange {};
     pushConstantRange.offset = 0;
     pushConstantRange.size = sizeof(PushConstantData);
-    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR;
+    pushConstantRange.stageFlags = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eCompute;
 
     vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo {};
     pipelineLayoutCreateInfo.setLayoutCount = descriptorSetLayouts.size();
@@ -351,6 +975,24 @@ void Renderer::InitializePipeline()
     vk::PipelineLibraryCreateInfoKHR libraryCreateInfo {};
     libraryCreateInfo.libraryCount = 0;
 
+    // Every quality level gets its own variant, so the path tracing loop is specialized at pipeline creation
+    std::array<vk::SpecializationMapEntry, 7> specializationEntries {};
+    specializationEntries.at(0) = vk::SpecializationMapEntry { 0, offsetof(PathTracingSettings, samplesPerLaunch), sizeof(uint32_t) };
+    specializationEntries.at(1) = vk::SpecializationMapEntry { 1, offsetof(PathTracingSettings, maxDepth), sizeof(uint32_t) };
+    specializationEntries.at(2) = vk::SpecializationMapEntry { 2, offsetof(PathTracingSettings, tMin), sizeof(float) };
+    specializationEntries.at(3) = vk::SpecializationMapEntry { 3, offsetof(PathTracingSettings, tMax), sizeof(float) };
+    specializationEntries.at(4) = vk::SpecializationMapEntry { 4, offsetof(PathTracingSettings, hitStrength), sizeof(float) };
+    specializationEntries.at(5) = vk::SpecializationMapEntry { 5, offsetof(PathTracingSettings, rouletteMinDepth), sizeof(uint32_t) };
+    specializationEntries.at(6) = vk::SpecializationMapEntry { 6, offsetof(PathTracingSettings, rouletteMaxSurvival), sizeof(float) };
+
+    vk::SpecializationInfo specializationInfo {};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = sizeof(PathTracingSettings);
+    raygenStage.pSpecializationInfo = &specializationInfo;
+    // The shadow rays of the light sampling start at the same offset from the surface as the other rays
+    chitStage.pSpecializationInfo = &specializationInfo;
+
     vk::RayTracingPipelineCreateInfoKHR pipelineCreateInfo {};
     pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStagesCreateInfo.size());
     pipelineCreateInfo.pStages = shaderStagesCreateInfo.data();
@@ -363,14 +1005,41 @@ void Renderer::InitializePipeline()
     pipelineCreateInfo.basePipelineHandle = nullptr;
     pipelineCreateInfo.basePipelineIndex = 0;
 
-    _pipeline = _vulkanContext->Device().createRayTracingPipelineKHR(nullptr, nullptr, pipelineCreateInfo, nullptr, _vulkanContext->Dldi()).value;
+    for (size_t i = 0; i < _pipelines.size(); ++i)
+    {
+        PathTracingPipeline& pathTracingPipeline = _pipelines.at(i);
+        pathTracingPipeline.settings = PathTracingSettings::FromQuality(static_cast<RenderQuality>(i));
+        specializationInfo.pData = &pathTracingPipeline.settings;
+
+        pathTracingPipeline.pipeline = _vulkanContext->Device().createRayTracingPipelineKHR(nullptr, nullptr, pipelineCreateInfo, nullptr, _vulkanContext->Dldi()).value;
+    }
 
     _vulkanContext->Device().destroyShaderModule(raygenModule);
     _vulkanContext->Device().destroyShaderModule(missModule);
+    _vulkanContext->Device().destroyShaderModule(shadowMissModule);
     _vulkanContext->Device().destroyShaderModule(chitModule);
 }
 
-void Renderer::InitializeShaderBindingTable()
+void Renderer::InitializeResolvePipeline()
+{
+    vk::ShaderModule resolveModule = Shader::CreateShaderModule("shaders/bin/resolve.comp.spv", _vulkanContext->Device());
+
+    vk::PipelineShaderStageCreateInfo resolveStage {};
+    resolveStage.stage = vk::ShaderStageFlagBits::eCompute;
+    resolveStage.module = resolveModule;
+    resolveStage.pName = "main";
+
+    // Shares the layout with the ray tracing pipeline, so the same descriptor set can be bound for both
+    vk::ComputePipelineCreateInfo pipelineCreateInfo {};
+    pipelineCreateInfo.stage = resolveStage;
+    pipelineCreateInfo.layout = _pipelineLayout;
+
+    _resolvePipeline = _vulkanContext->Device().createComputePipeline(nullptr, pipelineCreateInfo).value;
+
+    _vulkanContext->Device().destroyShaderModule(resolveModule);
+}
+
+void Renderer::InitializeShaderBindingTable(PathTracingPipeline& pathTracingPipeline)
 {
     auto AlignedSize = [](uint32_t value, uint32_t alignment)
     { return (value + alignment - 1) & ~(alignment - 1); };
@@ -378,7 +1047,8 @@ void Renderer::InitializeShaderBindingTable()
     const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties = _vulkanContext->RayTracingPipelineProperties();
     const uint32_t handleSize = rayTracingPipelineProperties.shaderGroupHandleSize;
     const uint32_t handleSizeAligned = AlignedSize(rayTracingPipelineProperties.shaderGroupHandleSize, rayTracingPipelineProperties.shaderGroupHandleAlignment);
-    const uint32_t shaderGroupCount = 3; // TODO: Get this from somewhere
+    const uint32_t shaderGroupCount = 4; // TODO: Get this from somewhere
+    const uint32_t missShaderCount = 2;
     vk::DeviceSize sbtSize = shaderGroupCount * handleSizeAligned;
 
     BufferCreation shaderBindingTableBufferCreation {};
@@ -387,84 +1057,260 @@ void Renderer::InitializeShaderBindingTable()
         .SetUsageFlags(vk::BufferUsageFlagBits::eShaderBindingTableKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress)
         .SetMemoryUsage(VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE)
         .SetIsMappable(true);
-    _raygenSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
+    pathTracingPipeline.raygenSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
 
     shaderBindingTableBufferCreation.SetName("Miss Shader Binding Table");
-    _missSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
+    pathTracingPipeline.missSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
 
     shaderBindingTableBufferCreation.SetName("Hit Shader Binding Table");
-    _hitSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
+    pathTracingPipeline.hitSBT = std::make_unique<Buffer>(shaderBindingTableBufferCreation, _vulkanContext);
 
-    std::vector<uint8_t> handles = _vulkanContext->Device().getRayTracingShaderGroupHandlesKHR<uint8_t>(_pipeline, 0, shaderGroupCount, sbtSize, _vulkanContext->Dldi());
+    std::vector<uint8_t> handles = _vulkanContext->Device().getRayTracingShaderGroupHandlesKHR<uint8_t>(pathTracingPipeline.pipeline, 0, shaderGroupCount, sbtSize, _vulkanContext->Dldi());
 
-    memcpy(_raygenSBT->mappedPtr, handles.data(), handleSize);
-    memcpy(_missSBT->mappedPtr, handles.data() + handleSizeAligned, handleSize);
-    memcpy(_hitSBT->mappedPtr, handles.data() + handleSizeAligned * 2, handleSize);
+    // Handles are returned tightly packed, while the entries in the tables have to be aligned
+    memcpy(pathTracingPipeline.raygenSBT->mappedPtr, handles.data(), handleSize);
+    for (uint32_t i = 0; i < missShaderCount; ++i)
+    {
+        memcpy(static_cast<uint8_t*>(pathTracingPipeline.missSBT->mappedPtr) + handleSizeAligned * i, handles.data() + handleSize * (1 + i), handleSize);
+    }
+    memcpy(pathTracingPipeline.hitSBT->mappedPtr, handles.data() + handleSize * (1 + missShaderCount), handleSize);
+
+    pathTracingPipeline.raygenAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(pathTracingPipeline.raygenSBT->buffer);
+    pathTracingPipeline.raygenAddressRegion.stride = handleSizeAligned;
+    pathTracingPipeline.raygenAddressRegion.size = handleSizeAligned;
 
-    _raygenAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_raygenSBT->buffer);
-    _raygenAddressRegion.stride = handleSizeAligned;
-    _raygenAddressRegion.size = handleSizeAligned;
+    pathTracingPipeline.missAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(pathTracingPipeline.missSBT->buffer);
+    pathTracingPipeline.missAddressRegion.stride = handleSizeAligned;
+    pathTracingPipeline.missAddressRegion.size = handleSizeAligned * missShaderCount;
+
+    pathTracingPipeline.hitAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(pathTracingPipeline.hitSBT->buffer);
+    pathTracingPipeline.hitAddressRegion.stride = handleSizeAligned;
+    pathTracingPipeline.hitAddressRegion.size = handleSizeAligned;
+}
 
-    _missAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_missSBT->buffer);
-    _missAddressRegion.stride = handleSizeAligned;
-    _missAddressRegion.size = handleSizeAligned;
+EmissiveTriangleCreation TransformEmissiveTriangle(const EmissiveTriangleCreation& triangle, const glm::mat4& transform)
+{
+    EmissiveTriangleCreation transformed = triangle;
+    transformed.p0 = glm::vec3(transform * glm::vec4(triangle.p0, 1.0f));
+    transformed.p1 = glm::vec3(transform * glm::vec4(triangle.p1, 1.0f));
+    transformed.p2 = glm::vec3(transform * glm::vec4(triangle.p2, 1.0f));
+    return transformed;
+}
 
-    _hitAddressRegion.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_hitSBT->buffer);
-    _hitAddressRegion.stride = handleSizeAligned;
-    _hitAddressRegion.size = handleSizeAligned;
+// Adds the emissive triangles of a mesh to those of the instance referencing it, placed with their transform inside the instance
+void AppendEmissiveTriangles(std::vector<EmissiveTriangleCreation>& triangles, const Mesh& mesh, const glm::mat4& transform)
+{
+    for (const auto& triangle : mesh.emissiveTriangles)
+    {
+        triangles.push_back(TransformEmissiveTriangle(triangle, transform));
+    }
 }
 
-BLASInput InitializeBLASInput(const std::shared_ptr<Model>& model, const Node& node, const Mesh& mesh, const std::shared_ptr<VulkanContext>& vulkanContext)
+// Adds the mesh as the next geometry of the input, optionally placed inside the structure with a transform
+void AppendBLASGeometry(BLASInput& input, const std::shared_ptr<Model>& model, const Mesh& mesh, const std::optional<glm::mat4>& transform, const std::shared_ptr<VulkanContext>& vulkanContext)
 {
-    BLASInput output {};
-    output.transform = node.GetWorldMatrix();
+    const vk::DeviceAddress vertexBufferDeviceAddress = vulkanContext->GetBufferDeviceAddress(model->vertexBuffer->buffer);
+    const vk::DeviceAddress indexBufferDeviceAddress = vulkanContext->GetBufferDeviceAddress(model->indexBuffer->buffer) + mesh.firstIndex * sizeof(uint32_t);
 
-    vk::DeviceOrHostAddressConstKHR vertexBufferDeviceAddress {};
-    vk::DeviceOrHostAddressConstKHR indexBufferDeviceAddress {};
-    vertexBufferDeviceAddress.deviceAddress = vulkanContext->GetBufferDeviceAddress(model->vertexBuffer->buffer);
-    indexBufferDeviceAddress.deviceAddress = vulkanContext->GetBufferDeviceAddress(model->indexBuffer->buffer) + mesh.firstIndex * sizeof(uint32_t);
+    // The builder reads the geometry from wherever it runs, while the shaders always fetch it from the device
+    vk::DeviceOrHostAddressConstKHR vertexData {};
+    vk::DeviceOrHostAddressConstKHR indexData {};
+    if (input.buildType == vk::AccelerationStructureBuildTypeKHR::eHost)
+    {
+        vertexData.hostAddress = model->vertices.data();
+        indexData.hostAddress = model->indices.data() + mesh.firstIndex;
+    }
+    else
+    {
+        vertexData.deviceAddress = vertexBufferDeviceAddress;
+        indexData.deviceAddress = indexBufferDeviceAddress;
+    }
 
     vk::AccelerationStructureGeometryTrianglesDataKHR trianglesData {};
     trianglesData.vertexFormat = vk::Format::eR32G32B32Sfloat;
-    trianglesData.vertexData = vertexBufferDeviceAddress;
+    trianglesData.vertexData = vertexData;
     trianglesData.maxVertex = model->verticesCount - 1;
     trianglesData.vertexStride = sizeof(Model::Vertex);
     trianglesData.indexType = vk::IndexType::eUint32;
-    trianglesData.indexData = indexBufferDeviceAddress;
-    trianglesData.transformData = {}; // Identity transform
+    trianglesData.indexData = indexData;
+    trianglesData.transformData = {}; // Identity transform, unless the structure provides a transform buffer
 
-    vk::AccelerationStructureGeometryKHR& accelerationStructureGeometry = output.geometry;
+    vk::AccelerationStructureGeometryKHR& accelerationStructureGeometry = input.geometries.emplace_back();
     accelerationStructureGeometry.flags = vk::GeometryFlagBitsKHR::eOpaque;
     accelerationStructureGeometry.geometryType = vk::GeometryTypeKHR::eTriangles;
     accelerationStructureGeometry.geometry.triangles = trianglesData;
 
     uint32_t primitiveCount = mesh.indexCount / 3;
 
-    vk::AccelerationStructureBuildRangeInfoKHR& buildRangeInfo = output.info;
+    vk::AccelerationStructureBuildRangeInfoKHR& buildRangeInfo = input.infos.emplace_back();
     buildRangeInfo.primitiveCount = primitiveCount;
     buildRangeInfo.primitiveOffset = 0;
     buildRangeInfo.firstVertex = 0;
     buildRangeInfo.transformOffset = 0;
 
-    GeometryNodeCreation& nodeCreation = output.node;
-    nodeCreation.vertexBufferDeviceAddress = vertexBufferDeviceAddress.deviceAddress;
-    nodeCreation.indexBufferDeviceAddress = indexBufferDeviceAddress.deviceAddress;
+    GeometryNodeCreation& nodeCreation = input.nodes.emplace_back();
+    nodeCreation.vertexBufferDeviceAddress = vertexBufferDeviceAddress;
+    nodeCreation.indexBufferDeviceAddress = indexBufferDeviceAddress;
     nodeCreation.material = mesh.material;
 
-    return output;
+    input.contentHash = HashCombine(input.contentHash, mesh.geometryHash);
+    input.bounds.Grow(transform.has_value() ? mesh.bounds.Transformed(transform.value()) : mesh.bounds);
+    if (transform.has_value())
+    {
+        nodeCreation.transform = transform.value();
+        input.transforms.push_back(transform.value());
+        input.contentHash = HashBytes(std::as_bytes(std::span<const glm::mat4>(&transform.value(), 1)), input.contentHash);
+    }
+}
+
+void Renderer::UpdateEmissiveTriangles()
+{
+    EmissiveTriangleResources& emissiveTriangles = _bindlessResources->EmissiveTriangles();
+    emissiveTriangles.Clear();
+
+    for (size_t i = 0; i < _tlasInstances.size(); ++i)
+    {
+        for (const auto& triangle : _instanceEmissiveTriangles[i])
+        {
+            emissiveTriangles.Create(TransformEmissiveTriangle(triangle, _tlasInstances[i].transform));
+        }
+    }
+}
+
+void Renderer::UnloadScene()
+{
+    if (!_tlas && _models.empty())
+    {
+        return;
+    }
+
+    _vulkanContext->Device().waitIdle();
+
+    _tlas.reset();
+    _tlasInstances.clear();
+    _instanceEmissiveTriangles.clear();
+    _instancesDirty = false;
+    _blases.clear();
+    _models.clear();
+    _scene.clear();
+    _bindlessResources->Clear();
+    _modelLoader->ClearTextureCache();
+}
+
+void Renderer::ResetAccumulation()
+{
+    _accumulatedFrames = 0;
+    _convergenceReadbackFrames.fill(0);
+    _unconvergedPixels.reset();
 }
 
 void Renderer::InitializeBLAS()
 {
+    // Building on the CPU spreads the work over all cores, instead of stalling on a single submission
+    const vk::AccelerationStructureBuildTypeKHR buildType = _vulkanContext->SupportsHostAccelerationStructureCommands()
+        ? vk::AccelerationStructureBuildTypeKHR::eHost
+        : vk::AccelerationStructureBuildTypeKHR::eDevice;
+
+    const auto AddBLAS = [&](const BLASInput& input)
+    {
+        _blases.emplace_back(input, _blasArena, _bindlessResources, _vulkanContext);
+        return static_cast<uint32_t>(_blases.size() - 1);
+    };
+
     for (const auto& model : _models)
     {
-        for (const auto& node : model->nodes)
+        switch (_blasGranularity)
+        {
+        case BLASGranularity::eMesh:
+        {
+            // Every mesh is built once, on first use, and placed in the scene by an instance per node referencing it
+            std::vector<std::optional<uint32_t>> meshBLASIndices(model->meshes.size());
+
+            for (const auto& node : model->nodes)
+            {
+                const glm::mat4 worldMatrix = node.GetWorldMatrix();
+
+                for (const auto mesh : node.meshes)
+                {
+                    std::optional<uint32_t>& blasIndex = meshBLASIndices[mesh];
+                    if (!blasIndex.has_value())
+                    {
+                        BLASInput input { .buildType = buildType };
+                        AppendBLASGeometry(input, model, model->meshes[mesh], std::nullopt, _vulkanContext);
+                        blasIndex = AddBLAS(input);
+                    }
+
+                    _tlasInstances.push_back(TLASInstance { blasIndex.value(), worldMatrix });
+                    _instanceEmissiveTriangles.push_back(model->meshes[mesh].emissiveTriangles);
+                }
+            }
+            break;
+        }
+        case BLASGranularity::eNode:
+        {
+            // Nodes referencing the same meshes share their structure
+            std::map<std::vector<uint32_t>, uint32_t> nodeBLASIndices {};
+
+            for (const auto& node : model->nodes)
+            {
+                if (node.meshes.empty())
+                {
+                    continue;
+                }
+
+                auto it = nodeBLASIndices.find(node.meshes);
+                if (it == nodeBLASIndices.end())
+                {
+                    BLASInput input { .buildType = buildType };
+                    for (const auto mesh : node.meshes)
+                    {
+                        AppendBLASGeometry(input, model, model->meshes[mesh], std::nullopt, _vulkanContext);
+                    }
+                    it = nodeBLASIndices.emplace(node.meshes, AddBLAS(input)).first;
+                }
+
+                _tlasInstances.push_back(TLASInstance { it->second, node.GetWorldMatrix() });
+                std::vector<EmissiveTriangleCreation>& emissiveTriangles = _instanceEmissiveTriangles.emplace_back();
+                for (const auto mesh : node.meshes)
+                {
+                    AppendEmissiveTriangles(emissiveTriangles, model->meshes[mesh], glm::mat4 { 1.0f });
+                }
+            }
+            break;
+        }
+        case BLASGranularity::eModel:
         {
-            for (const auto mesh : node.meshes)
+            BLASInput input { .buildType = buildType };
+            std::vector<EmissiveTriangleCreation> emissiveTriangles {};
+            for (const auto& node : model->nodes)
+            {
+                const glm::mat4 worldMatrix = node.GetWorldMatrix();
+                for (const auto mesh : node.meshes)
+                {
+                    AppendBLASGeometry(input, model, model->meshes[mesh], worldMatrix, _vulkanContext);
+                    AppendEmissiveTriangles(emissiveTriangles, model->meshes[mesh], worldMatrix);
+                }
+            }
+
+            if (!input.geometries.empty())
             {
-                BLASInput input = InitializeBLASInput(model, node, model->meshes[mesh], _vulkanContext);
-                _blases.emplace_back(input, _bindlessResources, _vulkanContext);
+                _tlasInstances.push_back(TLASInstance { AddBLAS(input), glm::mat4 { 1.0f } });
+                _instanceEmissiveTriangles.push_back(std::move(emissiveTriangles));
             }
+            break;
         }
+        }
+    }
+
+    spdlog::info("[RENDERER] Scene has {} instances of {} bottom level acceleration structures", _tlasInstances.size(), _blases.size());
+
+    // Only queued once all structures are created, as growing the vector moves them
+    BLASBuilder builder { _vulkanContext, _threadPool, _blasArena };
+    builder.SetCompaction(true);
+    builder.SetCache(_blasCache);
+    for (auto& blas : _blases)
+    {
+        builder.Add(blas);
     }
+    builder.Build();
 }
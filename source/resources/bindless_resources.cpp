@@ -1,17 +1,76 @@
 #include "resources/bindless_resources.hpp"
-#include "single_time_commands.hpp"
+#include "upload_manager.hpp"
 #include "vk_common.hpp"
 #include "vulkan_context.hpp"
+#include <glm/glm.hpp>
 #include <spdlog/spdlog.h>
 
-ImageResources::ImageResources(const std::shared_ptr<VulkanContext>& vulkanContext)
+// Fills in the alias table over the emitted power of the triangles (Vose's method), so the
+// shaders can pick a light proportional to its power in constant time. Returns the total power
+float BuildEmissiveTriangleAliasTable(std::vector<EmissiveTriangle>& triangles)
+{
+    const auto Power = [](const EmissiveTriangle& triangle)
+    { return glm::dot(triangle.emission, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * triangle.area; };
+
+    float totalPower = 0.0f;
+    for (const auto& triangle : triangles)
+    {
+        totalPower += Power(triangle);
+    }
+
+    if (totalPower <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    std::vector<float> scaledProbabilities(triangles.size());
+    std::vector<uint32_t> small {};
+    std::vector<uint32_t> large {};
+
+    for (uint32_t i = 0; i < triangles.size(); ++i)
+    {
+        scaledProbabilities[i] = Power(triangles[i]) / totalPower * static_cast<float>(triangles.size());
+        (scaledProbabilities[i] < 1.0f ? small : large).push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        const uint32_t less = small.back();
+        small.pop_back();
+        const uint32_t more = large.back();
+        large.pop_back();
+
+        triangles[less].aliasThreshold = scaledProbabilities[less];
+        triangles[less].alias = more;
+
+        scaledProbabilities[more] = (scaledProbabilities[more] + scaledProbabilities[less]) - 1.0f;
+        (scaledProbabilities[more] < 1.0f ? small : large).push_back(more);
+    }
+
+    // Remaining entries only differ from 1 because of floating point error
+    for (const uint32_t i : small)
+    {
+        triangles[i].aliasThreshold = 1.0f;
+        triangles[i].alias = i;
+    }
+    for (const uint32_t i : large)
+    {
+        triangles[i].aliasThreshold = 1.0f;
+        triangles[i].alias = i;
+    }
+
+    return totalPower;
+}
+
+ImageResources::ImageResources(const std::shared_ptr<VulkanContext>& vulkanContext, const std::shared_ptr<UploadManager>& uploadManager)
     : _vulkanContext(vulkanContext)
+    , _uploadManager(uploadManager)
 {
 }
 
 ResourceHandle<Image> ImageResources::Create(const ImageCreation& creation)
 {
-    return ResourceManager::Create(Image(creation, _vulkanContext));
+    return ResourceManager::Create(Image(creation, _vulkanContext, _uploadManager.get()));
 }
 
 MaterialResources::MaterialResources(const std::shared_ptr<VulkanContext>& vulkanContext)
@@ -30,6 +89,11 @@ ResourceHandle<GeometryNode> GeometryNodeResources::Create(const GeometryNodeCre
     return ResourceManager::Create(GeometryNode(creation));
 }
 
+ResourceHandle<EmissiveTriangle> EmissiveTriangleResources::Create(const EmissiveTriangleCreation& creation)
+{
+    return ResourceManager::Create(EmissiveTriangle(creation));
+}
+
 ResourceHandle<BLASInstance> BLASInstanceResources::Create(const BLASInstanceCreation& creation)
 {
     return ResourceManager::Create(BLASInstance(creation));
@@ -37,28 +101,23 @@ ResourceHandle<BLASInstance> BLASInstanceResources::Create(const BLASInstanceCre
 
 BindlessResources::BindlessResources(const std::shared_ptr<VulkanContext>& vulkanContext)
     : _vulkanContext(vulkanContext)
-    , _imageResources(vulkanContext)
+    , _uploadManager(std::make_shared<UploadManager>(vulkanContext))
+    , _imageResources(vulkanContext, _uploadManager)
     , _materialResources(vulkanContext)
 {
     InitializeSet();
     InitializeMaterialBuffer();
     InitializeGeometryNodeBuffer();
     InitializeBLASInstanceBuffer();
+    InitializeEmissiveTriangleBuffer();
 
     SamplerCreation fallbackSamplerCreation {};
     fallbackSamplerCreation.name = "Fallback sampler";
+    // Shared by all textures, the view of each texture clamps to its own mip chain
+    fallbackSamplerCreation.maxLod = VK_LOD_CLAMP_NONE;
     _fallbackSampler = std::make_unique<Sampler>(fallbackSamplerCreation, _vulkanContext);
 
-    constexpr uint32_t size = 2;
-    std::vector<std::byte> data {};
-    data.assign(size * size * 4, std::byte {});
-    ImageCreation fallbackImageCreation {};
-    fallbackImageCreation.SetName("Fallback texture")
-        .SetSize(size, size)
-        .SetUsageFlags(vk::ImageUsageFlagBits::eSampled)
-        .SetFormat(vk::Format::eR8G8B8A8Unorm)
-        .SetData(data);
-    _fallbackImage = _imageResources.Create(fallbackImageCreation);
+    InitializeFallbackImage();
 }
 
 BindlessResources::~BindlessResources()
@@ -73,6 +132,32 @@ void BindlessResources::UpdateDescriptorSet()
     UploadMaterials();
     UploadGeometryNodes();
     UploadBLASInstances();
+    UploadEmissiveTriangles();
+}
+
+void BindlessResources::Clear()
+{
+    _imageResources.Clear();
+    _materialResources.Clear();
+    _geometryNodeResources.Clear();
+    _blasInstanceResources.Clear();
+    _emissiveTriangleResources.Clear();
+
+    InitializeFallbackImage();
+}
+
+void BindlessResources::InitializeFallbackImage()
+{
+    constexpr uint32_t size = 2;
+    std::vector<std::byte> data {};
+    data.assign(size * size * 4, std::byte {});
+    ImageCreation fallbackImageCreation {};
+    fallbackImageCreation.SetName("Fallback texture")
+        .SetSize(size, size)
+        .SetUsageFlags(vk::ImageUsageFlagBits::eSampled)
+        .SetFormat(vk::Format::eR8G8B8A8Unorm)
+        .SetData(data);
+    _fallbackImage = _imageResources.Create(fallbackImageCreation);
 }
 
 void BindlessResources::UploadImages()
@@ -158,19 +243,8 @@ void BindlessResources::UploadGeometryNodes()
     }
 
     vk::DeviceSize bufferSize = _geometryNodeResources.GetAll().size() * sizeof(GeometryNode);
-    BufferCreation stagingBufferCreation {};
-    stagingBufferCreation.SetSize(bufferSize)
-        .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
-        .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
-        .SetIsMappable(true)
-        .SetName("GeometryNode staging buffer");
-    Buffer stagingBuffer(stagingBufferCreation, _vulkanContext);
-    std::memcpy(stagingBuffer.mappedPtr, _geometryNodeResources.GetAll().data(), bufferSize);
-
-    SingleTimeCommands commands(_vulkanContext);
-    commands.Record([&](vk::CommandBuffer commandBuffer)
-        { VkCopyBufferToBuffer(commandBuffer, stagingBuffer.buffer, _geometryNodeBuffer->buffer, bufferSize); });
-    commands.SubmitAndWait();
+    _uploadManager->UploadBuffer(_geometryNodeBuffer->buffer, std::as_bytes(std::span { _geometryNodeResources.GetAll() }));
+    _uploadManager->Flush();
 
     vk::DescriptorBufferInfo bufferInfo {};
     bufferInfo.buffer = _geometryNodeBuffer->buffer;
@@ -202,19 +276,8 @@ void BindlessResources::UploadBLASInstances()
     }
 
     vk::DeviceSize bufferSize = _blasInstanceResources.GetAll().size() * sizeof(BLASInstance);
-    BufferCreation stagingBufferCreation {};
-    stagingBufferCreation.SetSize(bufferSize)
-        .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
-        .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
-        .SetIsMappable(true)
-        .SetName("BLASInstance staging buffer");
-    Buffer stagingBuffer(stagingBufferCreation, _vulkanContext);
-    std::memcpy(stagingBuffer.mappedPtr, _blasInstanceResources.GetAll().data(), bufferSize);
-
-    SingleTimeCommands commands(_vulkanContext);
-    commands.Record([&](vk::CommandBuffer commandBuffer)
-        { VkCopyBufferToBuffer(commandBuffer, stagingBuffer.buffer, _blasInstanceBuffer->buffer, bufferSize); });
-    commands.SubmitAndWait();
+    _uploadManager->UploadBuffer(_blasInstanceBuffer->buffer, std::as_bytes(std::span { _blasInstanceResources.GetAll() }));
+    _uploadManager->Flush();
 
     vk::DescriptorBufferInfo bufferInfo {};
     bufferInfo.buffer = _blasInstanceBuffer->buffer;
@@ -232,12 +295,51 @@ void BindlessResources::UploadBLASInstances()
     _vulkanContext->Device().updateDescriptorSets(1, &descriptorWrite, 0, nullptr);
 }
 
+void BindlessResources::UploadEmissiveTriangles()
+{
+    std::vector<EmissiveTriangle> triangles = _emissiveTriangleResources.GetAll();
+
+    if (triangles.size() > MAX_EMISSIVE_TRIANGLES)
+    {
+        spdlog::error("[RESOURCES] Emissive triangle buffer is too small to fit all of the emissive triangles, disabling light sampling");
+        triangles.clear();
+    }
+
+    // The header is always written, so the shaders see an empty light list instead of stale data
+    EmissiveTrianglesHeader header {};
+    header.totalPower = BuildEmissiveTriangleAliasTable(triangles);
+    header.count = header.totalPower > 0.0f ? static_cast<uint32_t>(triangles.size()) : 0;
+
+    const vk::DeviceSize trianglesSize = header.count * sizeof(EmissiveTriangle);
+    const vk::DeviceSize bufferSize = sizeof(EmissiveTrianglesHeader) + trianglesSize;
+    _uploadManager->UploadBuffer(_emissiveTriangleBuffer->buffer, std::as_bytes(std::span { &header, 1 }));
+    _uploadManager->UploadBuffer(_emissiveTriangleBuffer->buffer, std::as_bytes(std::span { triangles.data(), header.count }), sizeof(EmissiveTrianglesHeader));
+    _uploadManager->Flush();
+
+    vk::DescriptorBufferInfo bufferInfo {};
+    bufferInfo.buffer = _emissiveTriangleBuffer->buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = bufferSize;
+
+    vk::WriteDescriptorSet descriptorWrite {};
+    descriptorWrite.dstSet = _bindlessSet;
+    descriptorWrite.dstBinding = static_cast<uint32_t>(BindlessBinding::eEmissiveTriangles);
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = vk::DescriptorType::eStorageBuffer;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    _vulkanContext->Device().updateDescriptorSets(1, &descriptorWrite, 0, nullptr);
+
+    spdlog::info("[RESOURCES] Uploaded {} emissive triangles for light sampling", header.count);
+}
+
 void BindlessResources::InitializeSet()
 {
     std::array<vk::DescriptorPoolSize, 3> poolSizes {
         vk::DescriptorPoolSize { vk::DescriptorType::eCombinedImageSampler, MAX_RESOURCES },
         vk::DescriptorPoolSize { vk::DescriptorType::eUniformBuffer, 1 },
-        vk::DescriptorPoolSize { vk::DescriptorType::eStorageBuffer, 2 }, // GeometryNode and BLASInstance
+        vk::DescriptorPoolSize { vk::DescriptorType::eStorageBuffer, 3 }, // GeometryNode, BLASInstance and EmissiveTriangle
     };
 
     vk::DescriptorPoolCreateInfo poolCreateInfo {};
@@ -247,7 +349,7 @@ void BindlessResources::InitializeSet()
     poolCreateInfo.pPoolSizes = poolSizes.data();
     VkCheckResult(_vulkanContext->Device().createDescriptorPool(&poolCreateInfo, nullptr, &_bindlessPool), "Failed creating bindless pool");
 
-    std::vector<vk::DescriptorSetLayoutBinding> bindings(4);
+    std::vector<vk::DescriptorSetLayoutBinding> bindings(5);
 
     vk::DescriptorSetLayoutBinding& combinedImageSampler = bindings[0];
     combinedImageSampler.descriptorType = vk::DescriptorType::eCombinedImageSampler;
@@ -273,6 +375,12 @@ void BindlessResources::InitializeSet()
     blasInstanceBinding.binding = static_cast<uint32_t>(BindlessBinding::eBLASInstances);
     blasInstanceBinding.stageFlags = vk::ShaderStageFlagBits::eClosestHitKHR;
 
+    vk::DescriptorSetLayoutBinding& emissiveTriangleBinding = bindings[4];
+    emissiveTriangleBinding.descriptorType = vk::DescriptorType::eStorageBuffer;
+    emissiveTriangleBinding.descriptorCount = 1;
+    emissiveTriangleBinding.binding = static_cast<uint32_t>(BindlessBinding::eEmissiveTriangles);
+    emissiveTriangleBinding.stageFlags = vk::ShaderStageFlagBits::eClosestHitKHR;
+
     vk::StructureChain<vk::DescriptorSetLayoutCreateInfo, vk::DescriptorSetLayoutBindingFlagsCreateInfo> structureChain;
 
     auto& layoutCreateInfo = structureChain.get<vk::DescriptorSetLayoutCreateInfo>();
@@ -280,7 +388,8 @@ void BindlessResources::InitializeSet()
     layoutCreateInfo.pBindings = bindings.data();
     layoutCreateInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
 
-    std::array<vk::DescriptorBindingFlagsEXT, 4> bindingFlags = {
+    std::array<vk::DescriptorBindingFlagsEXT, 5> bindingFlags = {
+        vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
         vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
         vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
         vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
@@ -336,3 +445,15 @@ void BindlessResources::InitializeBLASInstanceBuffer()
 
     _blasInstanceBuffer = std::make_unique<Buffer>(creation, _vulkanContext);
 }
+
+void BindlessResources::InitializeEmissiveTriangleBuffer()
+{
+    BufferCreation creation {};
+    creation.SetSize(sizeof(EmissiveTrianglesHeader) + MAX_EMISSIVE_TRIANGLES * sizeof(EmissiveTriangle))
+        .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
+        .SetIsMappable(false)
+        .SetName("EmissiveTriangle buffer");
+
+    _emissiveTriangleBuffer = std::make_unique<Buffer>(creation, _vulkanContext);
+}
@@ -1,6 +1,8 @@
 #include "resources/gpu_resources.hpp"
-#include "single_time_commands.hpp"
+#include "upload_manager.hpp"
 #include "vk_common.hpp"
+#include <cstdlib>
+#include <spdlog/spdlog.h>
 
 BufferCreation& BufferCreation::SetSize(vk::DeviceSize size)
 {
@@ -38,9 +40,11 @@ Buffer::Buffer(const BufferCreation& creation, const std::shared_ptr<VulkanConte
     vk::BufferCreateInfo bufferInfo {};
     bufferInfo.size = creation.size;
     bufferInfo.usage = creation.usage;
-    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
-    bufferInfo.queueFamilyIndexCount = 1;
-    bufferInfo.pQueueFamilyIndices = &_vulkanContext->QueueFamilies().graphicsFamily.value();
+    // Uploads, builds and rendering run on different queues, without ownership transfers in between
+    const std::vector<uint32_t>& queueFamilies = _vulkanContext->SharedQueueFamilies();
+    bufferInfo.sharingMode = queueFamilies.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+    bufferInfo.pQueueFamilyIndices = queueFamilies.data();
 
     VmaAllocationCreateInfo allocationInfo {};
     allocationInfo.usage = creation.memoryUsage;
@@ -173,7 +177,7 @@ Sampler& Sampler::operator=(Sampler&& other) noexcept
     return *this;
 }
 
-ImageCreation& ImageCreation::SetData(const std::vector<std::byte>& data)
+ImageCreation& ImageCreation::SetData(std::span<const std::byte> data)
 {
     this->data = data;
     return *this;
@@ -186,6 +190,12 @@ ImageCreation& ImageCreation::SetSize(uint32_t width, uint32_t height)
     return *this;
 }
 
+ImageCreation& ImageCreation::SetMipLevels(uint32_t mipLevels)
+{
+    this->mipLevels = mipLevels;
+    return *this;
+}
+
 ImageCreation& ImageCreation::SetFormat(vk::Format format)
 {
     this->format = format;
@@ -204,7 +214,7 @@ ImageCreation& ImageCreation::SetName(std::string_view name)
     return *this;
 }
 
-Image::Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>& vulkanContext)
+Image::Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>& vulkanContext, UploadManager* uploadManager)
     : format(creation.format)
     , _vulkanContext(vulkanContext)
 {
@@ -213,12 +223,20 @@ Image::Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>
     imageCreateInfo.extent.width = creation.width;
     imageCreateInfo.extent.height = creation.height;
     imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.mipLevels = creation.mipLevels;
     imageCreateInfo.arrayLayers = 1;
     imageCreateInfo.format = creation.format;
     imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
     imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
     imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+    // Uploaded on the transfer queue, render targets stay exclusive to the graphics queue
+    const std::vector<uint32_t>& queueFamilies = _vulkanContext->SharedQueueFamilies();
+    if (!creation.data.empty() && queueFamilies.size() > 1)
+    {
+        imageCreateInfo.sharingMode = vk::SharingMode::eConcurrent;
+        imageCreateInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageCreateInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
     imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
     imageCreateInfo.usage = creation.usage;
 
@@ -240,31 +258,35 @@ Image::Image(const ImageCreation& creation, const std::shared_ptr<VulkanContext>
     viewCreateInfo.format = creation.format;
     viewCreateInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
     viewCreateInfo.subresourceRange.baseMipLevel = 0;
-    viewCreateInfo.subresourceRange.levelCount = 1;
+    viewCreateInfo.subresourceRange.levelCount = creation.mipLevels;
     viewCreateInfo.subresourceRange.baseArrayLayer = 0;
     viewCreateInfo.subresourceRange.layerCount = 1;
     view = _vulkanContext->Device().createImageView(viewCreateInfo);
 
     if (!creation.data.empty())
     {
-        vk::DeviceSize imageSize = creation.width * creation.height * 4;
-
-        BufferCreation stagingBufferCreation {};
-        stagingBufferCreation.SetName("Image staging buffer")
-            .SetSize(imageSize)
-            .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
-            .SetIsMappable(true)
-            .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc);
-        Buffer stagingBuffer(stagingBufferCreation, _vulkanContext);
-        memcpy(stagingBuffer.mappedPtr, creation.data.data(), imageSize);
-
-        SingleTimeCommands commands(_vulkanContext);
-        commands.Record([&](vk::CommandBuffer commandBuffer)
-            {
-            VkTransitionImageLayout(commandBuffer, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-            VkCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image, creation.width, creation.height);
-            VkTransitionImageLayout(commandBuffer, image, format, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal); });
-        commands.SubmitAndWait();
+        vk::DeviceSize imageSize = 0;
+        for (uint32_t i = 0; i < creation.mipLevels; ++i)
+        {
+            imageSize += VkMipLevelSize(format, creation.width, creation.height, i);
+        }
+
+        // Without an upload the image would be handed out in an undefined layout
+        if (uploadManager == nullptr)
+        {
+            spdlog::error("[RESOURCES] Image {} has data, but no upload manager to copy it with", creation.name);
+            abort();
+        }
+
+        // The size is 0 for formats without a known level size
+        if (imageSize > 0 && creation.data.size() >= imageSize)
+        {
+            uploadManager->UploadImage(image, format, creation.width, creation.height, creation.mipLevels, creation.data.first(imageSize));
+        }
+        else
+        {
+            spdlog::error("[RESOURCES] Image {} has {} bytes of data, but its {} mip levels need {} bytes, skipping the upload", creation.name, creation.data.size(), creation.mipLevels, imageSize);
+        }
     }
 
     VkNameObject(image, creation.name, _vulkanContext);
@@ -435,7 +457,17 @@ Material::Material(const MaterialCreation& creation)
 
 GeometryNode::GeometryNode(const GeometryNodeCreation& creation)
 {
+    transform = creation.transform;
     vertexBufferDeviceAddress = creation.vertexBufferDeviceAddress;
     indexBufferDeviceAddress = creation.indexBufferDeviceAddress;
     materialIndex = creation.material.handle;
 }
+
+EmissiveTriangle::EmissiveTriangle(const EmissiveTriangleCreation& creation)
+{
+    p0 = creation.p0;
+    p1 = creation.p1;
+    p2 = creation.p2;
+    emission = creation.emission;
+    area = 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+}
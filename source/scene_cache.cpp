@@ -0,0 +1,374 @@
+#include "scene_cache.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "vk_common.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <glm/gtc/type_ptr.hpp>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+// Strings are stored in one table at the end of the entry, referenced by their offset and length in it
+struct CachedString
+{
+    uint32_t offset {};
+    uint32_t length {};
+};
+
+struct CachedNode
+{
+    // Parents are always stored before their children, -1 for the root
+    int32_t parent {};
+    uint32_t firstMesh {};
+    uint32_t meshCount {};
+    CachedString name {};
+    std::array<float, 16> localMatrix {};
+};
+
+struct CachedMaterial
+{
+    std::array<uint32_t, SceneMaterial::TEXTURE_SLOTS> textures {};
+    std::array<float, 4> albedoFactor {};
+    float metallicFactor {};
+    float roughnessFactor {};
+    float normalScale {};
+    float occlusionStrength {};
+    std::array<float, 3> emissiveFactor {};
+    uint32_t albedoUVChannel {};
+    // SCENE_INDEX_NONE when it's not set
+    uint32_t metallicRoughnessUVChannel {};
+    uint32_t normalUVChannel {};
+    uint32_t occlusionUVChannel {};
+    uint32_t emissiveUVChannel {};
+};
+
+struct CachedTexture
+{
+    CachedString path {};
+    uint32_t compression {};
+};
+
+static_assert(std::is_trivially_copyable_v<Model::Vertex> && std::is_trivially_copyable_v<SceneMesh>);
+
+// Elements of a section, empty when it doesn't fit in the entry or isn't aligned for the type
+template <typename T>
+std::optional<std::span<const T>> SectionData(std::span<const std::byte> data, uint64_t offset, uint64_t count)
+{
+    if (offset > data.size() || count > (data.size() - offset) / sizeof(T) || reinterpret_cast<uintptr_t>(data.data() + offset) % alignof(T) != 0)
+    {
+        return std::nullopt;
+    }
+    return std::span<const T> { reinterpret_cast<const T*>(data.data() + offset), static_cast<size_t>(count) };
+}
+
+std::optional<std::string> CachedStringValue(std::span<const char> strings, CachedString string)
+{
+    if (string.offset > strings.size() || string.length > strings.size() - string.offset)
+    {
+        return std::nullopt;
+    }
+    return std::string { strings.data() + string.offset, string.length };
+}
+
+// Pads the file up to the start of the section, which is always after the current position
+bool WriteSection(std::ofstream& file, uint64_t offset, std::span<const std::byte> data)
+{
+    constexpr std::array<char, 64> padding {};
+    uint64_t position = static_cast<uint64_t>(file.tellp());
+    while (position < offset)
+    {
+        const uint64_t paddingSize = std::min<uint64_t>(offset - position, padding.size());
+        file.write(padding.data(), static_cast<std::streamsize>(paddingSize));
+        position += paddingSize;
+    }
+
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return file.good();
+}
+
+SceneCache::SceneCache(const std::filesystem::path& directory)
+    : _directory(directory)
+{
+}
+
+std::optional<CachedScene> SceneCache::Load(const std::filesystem::path& modelPath) const
+{
+    std::error_code sizeError {}, timeError {};
+    const uintmax_t sourceSize = std::filesystem::file_size(modelPath, sizeError);
+    const std::filesystem::file_time_type sourceWriteTime = std::filesystem::last_write_time(modelPath, timeError);
+    if (sizeError || timeError)
+    {
+        return std::nullopt;
+    }
+
+    const std::filesystem::path path = EntryPath(modelPath);
+    auto file = std::make_unique<MappedFile>(path);
+    if (!file->IsOpen())
+    {
+        return std::nullopt;
+    }
+
+    const std::span<const std::byte> data = file->Data();
+    EntryHeader header {};
+    if (data.size() >= sizeof(EntryHeader))
+    {
+        std::memcpy(&header, data.data(), sizeof(EntryHeader));
+    }
+
+    if (header.magic != ENTRY_MAGIC)
+    {
+        spdlog::warn("[FILE] Ignoring invalid scene cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    if (header.version != ENTRY_VERSION)
+    {
+        return std::nullopt;
+    }
+
+    if (header.sourceSize != sourceSize || header.sourceWriteTime != static_cast<int64_t>(sourceWriteTime.time_since_epoch().count()))
+    {
+        spdlog::info("[FILE] Scene cache entry of {} is out of date", modelPath.string());
+        return std::nullopt;
+    }
+
+    const auto vertices = SectionData<Model::Vertex>(data, header.vertices.offset, header.vertices.count);
+    const auto indices = SectionData<uint32_t>(data, header.indices.offset, header.indices.count);
+    const auto nodes = SectionData<CachedNode>(data, header.nodes.offset, header.nodes.count);
+    const auto nodeMeshes = SectionData<uint32_t>(data, header.nodeMeshes.offset, header.nodeMeshes.count);
+    const auto meshes = SectionData<SceneMesh>(data, header.meshes.offset, header.meshes.count);
+    const auto materials = SectionData<CachedMaterial>(data, header.materials.offset, header.materials.count);
+    const auto textures = SectionData<CachedTexture>(data, header.textures.offset, header.textures.count);
+    const auto strings = SectionData<char>(data, header.strings.offset, header.strings.count);
+    const auto name = strings ? CachedStringValue(strings.value(), CachedString { static_cast<uint32_t>(header.name.offset), static_cast<uint32_t>(header.name.count) }) : std::nullopt;
+
+    if (!vertices || !indices || !nodes || !nodeMeshes || !meshes || !materials || !textures || !name)
+    {
+        spdlog::warn("[FILE] Ignoring truncated scene cache entry: {}", path.string());
+        return std::nullopt;
+    }
+
+    CachedScene cached {};
+    SceneData& scene = cached.scene;
+    scene.name = name.value();
+    scene.vertices = vertices.value();
+    scene.indices = indices.value();
+
+    // Reserved up front, as nodes point at their parents
+    scene.nodes.reserve(nodes->size());
+    for (const auto& cachedNode : nodes.value())
+    {
+        const std::optional<std::string> nodeName = CachedStringValue(strings.value(), cachedNode.name);
+        if (cachedNode.parent >= static_cast<int64_t>(scene.nodes.size()) || cachedNode.firstMesh > nodeMeshes->size() || cachedNode.meshCount > nodeMeshes->size() - cachedNode.firstMesh || !nodeName)
+        {
+            spdlog::warn("[FILE] Ignoring invalid scene cache entry: {}", path.string());
+            return std::nullopt;
+        }
+
+        Node& node = scene.nodes.emplace_back();
+        node.name = nodeName.value();
+        node.parent = cachedNode.parent >= 0 ? &scene.nodes[cachedNode.parent] : nullptr;
+        node.localMatrix = glm::make_mat4(cachedNode.localMatrix.data());
+        node.meshes.assign(nodeMeshes->begin() + cachedNode.firstMesh, nodeMeshes->begin() + cachedNode.firstMesh + cachedNode.meshCount);
+    }
+
+    for (const auto& mesh : meshes.value())
+    {
+        if (mesh.firstIndex > indices->size() || mesh.indexCount > indices->size() - mesh.firstIndex || mesh.indexCount % 3 != 0
+            || mesh.firstVertex > vertices->size() || (mesh.material != SCENE_INDEX_NONE && mesh.material >= materials->size()))
+        {
+            spdlog::warn("[FILE] Ignoring invalid scene cache entry: {}", path.string());
+            return std::nullopt;
+        }
+
+        // The indices are read on the CPU for the emissive triangles and by the acceleration structure builds, so none may point past the vertices
+        const auto meshIndices = indices->subspan(mesh.firstIndex, mesh.indexCount);
+        const auto PastVertices = [&](uint32_t index)
+        { return index >= vertices->size(); };
+        if (std::any_of(meshIndices.begin(), meshIndices.end(), PastVertices))
+        {
+            spdlog::warn("[FILE] Ignoring invalid scene cache entry: {}", path.string());
+            return std::nullopt;
+        }
+        scene.meshes.push_back(mesh);
+    }
+
+    for (const auto& cachedMaterial : materials.value())
+    {
+        SceneMaterial& material = scene.materials.emplace_back();
+        material.textures = cachedMaterial.textures;
+
+        MaterialCreation& creation = material.creation;
+        creation.albedoFactor = glm::make_vec4(cachedMaterial.albedoFactor.data());
+        creation.albedoUVChannel = cachedMaterial.albedoUVChannel;
+        creation.metallicFactor = cachedMaterial.metallicFactor;
+        creation.roughnessFactor = cachedMaterial.roughnessFactor;
+        if (cachedMaterial.metallicRoughnessUVChannel != SCENE_INDEX_NONE)
+        {
+            creation.metallicRoughnessUVChannel = cachedMaterial.metallicRoughnessUVChannel;
+        }
+        creation.normalScale = cachedMaterial.normalScale;
+        creation.normalUVChannel = cachedMaterial.normalUVChannel;
+        creation.occlusionStrength = cachedMaterial.occlusionStrength;
+        creation.occlusionUVChannel = cachedMaterial.occlusionUVChannel;
+        creation.emissiveFactor = glm::make_vec3(cachedMaterial.emissiveFactor.data());
+        creation.emissiveUVChannel = cachedMaterial.emissiveUVChannel;
+    }
+
+    for (const auto& cachedTexture : textures.value())
+    {
+        const std::optional<std::string> texturePath = CachedStringValue(strings.value(), cachedTexture.path);
+        if (!texturePath || cachedTexture.compression > static_cast<uint32_t>(TextureCompression::eBC7))
+        {
+            spdlog::warn("[FILE] Ignoring invalid scene cache entry: {}", path.string());
+            return std::nullopt;
+        }
+        scene.textures.push_back(SceneTexture { .path = texturePath.value(), .compression = static_cast<TextureCompression>(cachedTexture.compression) });
+    }
+
+    cached.file = std::move(file);
+    return cached;
+}
+
+void SceneCache::Store(const std::filesystem::path& modelPath, const SceneData& scene) const
+{
+    std::error_code sizeError {}, timeError {};
+    const uintmax_t sourceSize = std::filesystem::file_size(modelPath, sizeError);
+    const std::filesystem::file_time_type sourceWriteTime = std::filesystem::last_write_time(modelPath, timeError);
+    if (sizeError || timeError)
+    {
+        return;
+    }
+
+    std::error_code error {};
+    std::filesystem::create_directories(_directory, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed creating scene cache directory {}: {}", _directory.string(), error.message());
+        return;
+    }
+
+    std::string strings {};
+    const auto addString = [&](std::string_view value)
+    {
+        const CachedString string { static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size()) };
+        strings += value;
+        return string;
+    };
+
+    std::vector<CachedNode> nodes {};
+    std::vector<uint32_t> nodeMeshes {};
+    nodes.reserve(scene.nodes.size());
+    for (const auto& node : scene.nodes)
+    {
+        CachedNode& cachedNode = nodes.emplace_back();
+        cachedNode.parent = node.parent ? static_cast<int32_t>(node.parent - scene.nodes.data()) : -1;
+        cachedNode.firstMesh = static_cast<uint32_t>(nodeMeshes.size());
+        cachedNode.meshCount = static_cast<uint32_t>(node.meshes.size());
+        cachedNode.name = addString(node.name);
+        std::memcpy(cachedNode.localMatrix.data(), glm::value_ptr(node.localMatrix), sizeof(cachedNode.localMatrix));
+        nodeMeshes.insert(nodeMeshes.end(), node.meshes.begin(), node.meshes.end());
+    }
+
+    std::vector<CachedMaterial> materials {};
+    materials.reserve(scene.materials.size());
+    for (const auto& material : scene.materials)
+    {
+        const MaterialCreation& creation = material.creation;
+        materials.push_back(CachedMaterial {
+            .textures = material.textures,
+            .albedoFactor = { creation.albedoFactor.r, creation.albedoFactor.g, creation.albedoFactor.b, creation.albedoFactor.a },
+            .metallicFactor = creation.metallicFactor,
+            .roughnessFactor = creation.roughnessFactor,
+            .normalScale = creation.normalScale,
+            .occlusionStrength = creation.occlusionStrength,
+            .emissiveFactor = { creation.emissiveFactor.r, creation.emissiveFactor.g, creation.emissiveFactor.b },
+            .albedoUVChannel = creation.albedoUVChannel,
+            .metallicRoughnessUVChannel = creation.metallicRoughnessUVChannel.value_or(SCENE_INDEX_NONE),
+            .normalUVChannel = creation.normalUVChannel,
+            .occlusionUVChannel = creation.occlusionUVChannel,
+            .emissiveUVChannel = creation.emissiveUVChannel,
+        });
+    }
+
+    std::vector<CachedTexture> textures {};
+    textures.reserve(scene.textures.size());
+    for (const auto& texture : scene.textures)
+    {
+        textures.push_back(CachedTexture { .path = addString(texture.path), .compression = static_cast<uint32_t>(texture.compression) });
+    }
+
+    const CachedString name = addString(scene.name);
+
+    EntryHeader header {
+        .magic = ENTRY_MAGIC,
+        .version = ENTRY_VERSION,
+        .sourceSize = sourceSize,
+        .sourceWriteTime = static_cast<int64_t>(sourceWriteTime.time_since_epoch().count()),
+        .name = { name.offset, name.length },
+    };
+
+    // Sections follow the header in the order of its fields
+    uint64_t entrySize = sizeof(EntryHeader);
+    const auto placeSection = [&](uint64_t count, uint64_t elementSize)
+    {
+        const Section section { VkAlignUp(entrySize, SECTION_ALIGNMENT), count };
+        entrySize = section.offset + count * elementSize;
+        return section;
+    };
+    header.vertices = placeSection(scene.vertices.size(), sizeof(Model::Vertex));
+    header.indices = placeSection(scene.indices.size(), sizeof(uint32_t));
+    header.nodes = placeSection(nodes.size(), sizeof(CachedNode));
+    header.nodeMeshes = placeSection(nodeMeshes.size(), sizeof(uint32_t));
+    header.meshes = placeSection(scene.meshes.size(), sizeof(SceneMesh));
+    header.materials = placeSection(materials.size(), sizeof(CachedMaterial));
+    header.textures = placeSection(textures.size(), sizeof(CachedTexture));
+    header.strings = placeSection(strings.size(), sizeof(char));
+
+    // Written next to the entry and moved in place, so an interrupted write never leaves a truncated entry behind.
+    // The name is unique per thread, as the same model can be loaded by multiple threads
+    const std::filesystem::path path = EntryPath(modelPath);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += fmt::format(".{}.tmp", std::hash<std::thread::id> {}(std::this_thread::get_id()));
+
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        const bool written = WriteSection(file, 0, std::as_bytes(std::span { &header, 1 }))
+            && WriteSection(file, header.vertices.offset, std::as_bytes(scene.vertices))
+            && WriteSection(file, header.indices.offset, std::as_bytes(scene.indices))
+            && WriteSection(file, header.nodes.offset, std::as_bytes(std::span { nodes }))
+            && WriteSection(file, header.nodeMeshes.offset, std::as_bytes(std::span { nodeMeshes }))
+            && WriteSection(file, header.meshes.offset, std::as_bytes(std::span { scene.meshes }))
+            && WriteSection(file, header.materials.offset, std::as_bytes(std::span { materials }))
+            && WriteSection(file, header.textures.offset, std::as_bytes(std::span { textures }))
+            && WriteSection(file, header.strings.offset, std::as_bytes(std::span { strings }));
+        if (!written)
+        {
+            spdlog::warn("[FILE] Failed writing scene cache entry: {}", temporaryPath.string());
+            // Closed first, as open files can't be removed on every platform
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        spdlog::warn("[FILE] Failed writing scene cache entry {}: {}", path.string(), error.message());
+        std::filesystem::remove(temporaryPath, error);
+        return;
+    }
+
+    spdlog::info("[FILE] Stored {} in the scene cache, {} KiB", modelPath.string(), entrySize / 1024);
+}
+
+std::filesystem::path SceneCache::EntryPath(const std::filesystem::path& modelPath) const
+{
+    // Keyed on the absolute path, so the same model is found from any working directory
+    std::error_code error {};
+    const std::string normalizedPath = std::filesystem::absolute(modelPath, error).lexically_normal().generic_string();
+    const uint64_t key = HashBytes(std::as_bytes(std::span { normalizedPath }));
+    return _directory / fmt::format("{:016x}.scene", key);
+}
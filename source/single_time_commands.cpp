@@ -2,31 +2,34 @@
 #include "vk_common.hpp"
 #include "vulkan_context.hpp"
 
-SingleTimeCommands::SingleTimeCommands(std::shared_ptr<VulkanContext> context)
+SingleTimeCommands::SingleTimeCommands(std::shared_ptr<VulkanContext> context, QueueType queueType)
     : _vulkanContext(context)
+    , _queueType(queueType)
 {
     vk::CommandBufferAllocateInfo allocateInfo {};
     allocateInfo.level = vk::CommandBufferLevel::ePrimary;
-    allocateInfo.commandPool = _vulkanContext->CommandPool();
+    allocateInfo.commandPool = _vulkanContext->CommandPool(_queueType);
     allocateInfo.commandBufferCount = 1;
 
     VkCheckResult(_vulkanContext->Device().allocateCommandBuffers(&allocateInfo, &_commandBuffer), "[VULKAN] Failed allocating one time command buffer!");
 
-    vk::FenceCreateInfo fenceInfo {};
-    VkCheckResult(_vulkanContext->Device().createFence(&fenceInfo, nullptr, &_fence), "[VULKAN] Failed creating single time command fence!");
-
     vk::CommandBufferBeginInfo beginInfo {};
     beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
 
     VkCheckResult(_commandBuffer.begin(&beginInfo), "[VULKAN] Failed beginning one time command buffer!");
 }
 
+SingleTimeCommands::SingleTimeCommands(std::shared_ptr<VulkanContext> context)
+    : SingleTimeCommands(std::move(context), QueueType::eGraphics)
+{
+}
+
 SingleTimeCommands::~SingleTimeCommands()
 {
+    // The command buffer can only be freed once it has executed
     SubmitAndWait();
 
-    _vulkanContext->Device().free(_vulkanContext->CommandPool(), _commandBuffer);
-    _vulkanContext->Device().destroy(_fence);
+    _vulkanContext->Device().free(_vulkanContext->CommandPool(_queueType), _commandBuffer);
 }
 
 void SingleTimeCommands::Record(const std::function<void(vk::CommandBuffer)>& commands) const
@@ -34,20 +37,54 @@ void SingleTimeCommands::Record(const std::function<void(vk::CommandBuffer)>& co
     commands(_commandBuffer);
 }
 
-void SingleTimeCommands::SubmitAndWait()
+void SingleTimeCommands::WaitFor(QueueType queueType, uint64_t timelineValue, vk::PipelineStageFlags2 stages)
+{
+    vk::SemaphoreSubmitInfo& wait = _waits.emplace_back();
+    wait.semaphore = _vulkanContext->Timeline(queueType);
+    wait.value = timelineValue;
+    wait.stageMask = stages;
+}
+
+uint64_t SingleTimeCommands::Submit()
 {
     if (_submitted)
     {
-        return;
+        return _timelineValue;
     }
     _submitted = true;
 
     _commandBuffer.end();
 
-    vk::SubmitInfo submitInfo {};
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffer;
+    _timelineValue = _vulkanContext->NextTimelineValue(_queueType);
+
+    vk::SemaphoreSubmitInfo signal {};
+    signal.semaphore = _vulkanContext->Timeline(_queueType);
+    signal.value = _timelineValue;
+    signal.stageMask = vk::PipelineStageFlagBits2::eAllCommands;
+
+    vk::CommandBufferSubmitInfo commandBufferInfo {};
+    commandBufferInfo.commandBuffer = _commandBuffer;
+
+    vk::SubmitInfo2 submitInfo {};
+    submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(_waits.size());
+    submitInfo.pWaitSemaphoreInfos = _waits.data();
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &signal;
+
+    VkCheckResult(_vulkanContext->Queue(_queueType).submit2(1, &submitInfo, nullptr), "Failed submitting one time buffer to queue!");
+    return _timelineValue;
+}
+
+void SingleTimeCommands::SubmitAndWait()
+{
+    const uint64_t timelineValue = Submit();
+    const vk::Semaphore timeline = _vulkanContext->Timeline(_queueType);
 
-    VkCheckResult(_vulkanContext->GraphicsQueue().submit(1, &submitInfo, _fence), "Failed submitting one time buffer to queue!");
-    VkCheckResult(_vulkanContext->Device().waitForFences(1, &_fence, vk::True, std::numeric_limits<uint64_t>::max()), "Failed waiting for fence!");
+    vk::SemaphoreWaitInfo waitInfo {};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline;
+    waitInfo.pValues = &timelineValue;
+    VkCheckResult(_vulkanContext->Device().waitSemaphores(&waitInfo, std::numeric_limits<uint64_t>::max()), "Failed waiting for timeline semaphore!");
 }
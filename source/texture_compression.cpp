@@ -0,0 +1,327 @@
+#include "texture_compression.hpp"
+#include "vk_common.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+constexpr uint32_t BLOCK_TEXELS = 16;
+
+// RGBA texels of a 4x4 block, in row order
+using BlockTexels = std::array<std::array<uint8_t, 4>, BLOCK_TEXELS>;
+
+// BC7 interpolation weights for 4-bit indices, out of 64
+constexpr std::array<uint32_t, 16> BC7_WEIGHTS { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Fields of a block are packed from the least significant bit up
+struct BlockBits
+{
+    std::array<uint64_t, 2> words {};
+    uint32_t position = 0;
+
+    void Write(uint64_t value, uint32_t bits)
+    {
+        const uint32_t word = position / 64;
+        const uint32_t offset = position % 64;
+        words[word] |= value << offset;
+        if (offset + bits > 64)
+        {
+            words[word + 1] |= value >> (64 - offset);
+        }
+        position += bits;
+    }
+};
+
+BlockTexels FetchBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY)
+{
+    BlockTexels texels {};
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            const uint32_t pixelX = std::min(blockX * 4 + x, width - 1);
+            const uint32_t pixelY = std::min(blockY * 4 + y, height - 1);
+            std::memcpy(texels[y * 4 + x].data(), pixels + (static_cast<size_t>(pixelY) * width + pixelX) * 4, 4);
+        }
+    }
+    return texels;
+}
+
+// Endpoints are the extremes of the channel, the six values between them are interpolated
+uint64_t EncodeBC4Block(const BlockTexels& texels, uint32_t channel)
+{
+    uint8_t minValue = 255;
+    uint8_t maxValue = 0;
+    for (const auto& texel : texels)
+    {
+        minValue = std::min(minValue, texel[channel]);
+        maxValue = std::max(maxValue, texel[channel]);
+    }
+
+    // With red0 > red1 the codes are red0, red1 and then the interpolated values from red0 to red1
+    uint64_t block = maxValue | (static_cast<uint64_t>(minValue) << 8);
+    if (maxValue == minValue)
+    {
+        return block;
+    }
+
+    const float scale = 7.0f / static_cast<float>(maxValue - minValue);
+    for (uint32_t i = 0; i < BLOCK_TEXELS; ++i)
+    {
+        const auto step = static_cast<uint64_t>(std::lround(static_cast<float>(maxValue - texels[i][channel]) * scale));
+        const uint64_t code = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+        block |= code << (16 + 3 * i);
+    }
+
+    return block;
+}
+
+// Mode 6: 7-bit RGBA endpoints with a p-bit each and 4-bit indices
+std::array<uint64_t, 2> EncodeBC7Block(const BlockTexels& texels)
+{
+    std::array<float, 4> mean {};
+    for (const auto& texel : texels)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            mean[c] += static_cast<float>(texel[c]) / BLOCK_TEXELS;
+        }
+    }
+
+    std::array<std::array<float, 4>, 4> covariance {};
+    for (const auto& texel : texels)
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+            }
+        }
+    }
+
+    // Principal axis with power iteration, flat blocks keep the diagonal and end up with both endpoints at the mean
+    std::array<float, 4> axis { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (uint32_t iteration = 0; iteration < 8; ++iteration)
+    {
+        std::array<float, 4> next {};
+        float largest = 0.0f;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                next[i] += covariance[i][j] * axis[j];
+            }
+            largest = std::max(largest, std::abs(next[i]));
+        }
+
+        if (largest < 1e-6f)
+        {
+            break;
+        }
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            axis[i] = next[i] / largest;
+        }
+    }
+
+    const float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+    float minProjection = 0.0f;
+    float maxProjection = 0.0f;
+    for (const auto& texel : texels)
+    {
+        float projection = 0.0f;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            projection += (texel[c] - mean[c]) * axis[c];
+        }
+        minProjection = std::min(minProjection, projection / axisLength2);
+        maxProjection = std::max(maxProjection, projection / axisLength2);
+    }
+
+    std::array<float, 4> low {};
+    std::array<float, 4> high {};
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        low[c] = std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f);
+        high[c] = std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f);
+    }
+
+    // Every combination of p-bits is tried, as they shift the endpoints by one step of the 8-bit range
+    uint64_t bestError = std::numeric_limits<uint64_t>::max();
+    std::array<std::array<uint32_t, 4>, 2> bestEndpoints {};
+    std::array<uint32_t, 2> bestPBits {};
+    std::array<uint32_t, BLOCK_TEXELS> bestIndices {};
+
+    for (uint32_t pBits = 0; pBits < 4; ++pBits)
+    {
+        const std::array<uint32_t, 2> p { pBits & 1, pBits >> 1 };
+        std::array<std::array<uint32_t, 4>, 2> endpoints {};
+        std::array<std::array<int32_t, 4>, 2> expanded {};
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = std::clamp<int32_t>(std::lround((low[c] - p[0]) / 2.0f), 0, 127);
+            endpoints[1][c] = std::clamp<int32_t>(std::lround((high[c] - p[1]) / 2.0f), 0, 127);
+            expanded[0][c] = static_cast<int32_t>(endpoints[0][c] << 1 | p[0]);
+            expanded[1][c] = static_cast<int32_t>(endpoints[1][c] << 1 | p[1]);
+        }
+
+        std::array<int32_t, 4> direction {};
+        int32_t directionLength2 = 0;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            direction[c] = expanded[1][c] - expanded[0][c];
+            directionLength2 += direction[c] * direction[c];
+        }
+
+        uint64_t error = 0;
+        std::array<uint32_t, BLOCK_TEXELS> indices {};
+        for (uint32_t i = 0; i < BLOCK_TEXELS; ++i)
+        {
+            // Projected onto the endpoints, and snapped to the closest weight
+            int32_t dot = 0;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                dot += (texels[i][c] - expanded[0][c]) * direction[c];
+            }
+            const float weight = directionLength2 > 0 ? std::clamp(static_cast<float>(dot) / static_cast<float>(directionLength2), 0.0f, 1.0f) * 64.0f : 0.0f;
+
+            uint32_t index = 0;
+            for (uint32_t w = 1; w < BC7_WEIGHTS.size(); ++w)
+            {
+                if (std::abs(static_cast<float>(BC7_WEIGHTS[w]) - weight) < std::abs(static_cast<float>(BC7_WEIGHTS[index]) - weight))
+                {
+                    index = w;
+                }
+            }
+            indices[i] = index;
+
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                const int32_t value = static_cast<int32_t>(((64 - BC7_WEIGHTS[index]) * expanded[0][c] + BC7_WEIGHTS[index] * expanded[1][c] + 32) >> 6);
+                const int32_t difference = value - texels[i][c];
+                error += static_cast<uint64_t>(difference * difference);
+            }
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            bestEndpoints = endpoints;
+            bestPBits = p;
+            bestIndices = indices;
+        }
+    }
+
+    // The most significant bit of the first index is implied to be zero, which swapping the endpoints ensures
+    if (bestIndices[0] >= 8)
+    {
+        std::swap(bestEndpoints[0], bestEndpoints[1]);
+        std::swap(bestPBits[0], bestPBits[1]);
+        for (auto& index : bestIndices)
+        {
+            index = 15 - index;
+        }
+    }
+
+    BlockBits bits {};
+    bits.Write(1 << 6, 7);
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        bits.Write(bestEndpoints[0][c], 7);
+        bits.Write(bestEndpoints[1][c], 7);
+    }
+    bits.Write(bestPBits[0], 1);
+    bits.Write(bestPBits[1], 1);
+    bits.Write(bestIndices[0], 3);
+    for (uint32_t i = 1; i < BLOCK_TEXELS; ++i)
+    {
+        bits.Write(bestIndices[i], 4);
+    }
+
+    return bits.words;
+}
+
+vk::Format TextureCompressionFormat(TextureCompression compression)
+{
+    switch (compression)
+    {
+    case TextureCompression::eBC4:
+        return vk::Format::eBc4UnormBlock;
+    case TextureCompression::eBC5:
+        return vk::Format::eBc5UnormBlock;
+    case TextureCompression::eBC7:
+        return vk::Format::eBc7UnormBlock;
+    default:
+        return vk::Format::eR8G8B8A8Unorm;
+    }
+}
+
+TextureData CompressTexture(const TextureData& texture, TextureCompression compression)
+{
+    TextureData compressed {};
+    compressed.format = TextureCompressionFormat(compression);
+    compressed.width = texture.width;
+    compressed.height = texture.height;
+    compressed.mipLevels = texture.mipLevels;
+
+    if (compression == TextureCompression::eNone)
+    {
+        compressed.data = texture.data;
+        return compressed;
+    }
+
+    vk::DeviceSize compressedSize = 0;
+    for (uint32_t i = 0; i < texture.mipLevels; ++i)
+    {
+        compressedSize += VkMipLevelSize(compressed.format, texture.width, texture.height, i);
+    }
+    compressed.data.resize(compressedSize);
+
+    const auto* source = reinterpret_cast<const uint8_t*>(texture.data.data());
+    std::byte* destination = compressed.data.data();
+
+    for (uint32_t level = 0; level < texture.mipLevels; ++level)
+    {
+        const uint32_t levelWidth = std::max(texture.width >> level, 1u);
+        const uint32_t levelHeight = std::max(texture.height >> level, 1u);
+
+        for (uint32_t blockY = 0; blockY < (levelHeight + 3) / 4; ++blockY)
+        {
+            for (uint32_t blockX = 0; blockX < (levelWidth + 3) / 4; ++blockX)
+            {
+                const BlockTexels texels = FetchBlock(source, levelWidth, levelHeight, blockX, blockY);
+
+                switch (compression)
+                {
+                case TextureCompression::eBC4:
+                {
+                    const uint64_t block = EncodeBC4Block(texels, 0);
+                    std::memcpy(destination, &block, sizeof(block));
+                    destination += sizeof(block);
+                    break;
+                }
+                case TextureCompression::eBC5:
+                {
+                    const std::array<uint64_t, 2> block { EncodeBC4Block(texels, 0), EncodeBC4Block(texels, 1) };
+                    std::memcpy(destination, block.data(), sizeof(block));
+                    destination += sizeof(block);
+                    break;
+                }
+                default:
+                {
+                    const std::array<uint64_t, 2> block = EncodeBC7Block(texels);
+                    std::memcpy(destination, block.data(), sizeof(block));
+                    destination += sizeof(block);
+                    break;
+                }
+                }
+            }
+        }
+
+        source += VkMipLevelSize(texture.format, texture.width, texture.height, level);
+    }
+
+    return compressed;
+}
@@ -0,0 +1,40 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    _workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        _workers.emplace_back([this](const std::stop_token& stopToken)
+            { WorkerLoop(stopToken); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    // Destroying the jthreads requests them to stop, which also wakes up waiting workers, and joins them.
+    // This has to happen before the queue and its mutex are destroyed.
+    _workers.clear();
+}
+
+void ThreadPool::WorkerLoop(const std::stop_token& stopToken)
+{
+    while (!stopToken.stop_requested())
+    {
+        std::function<void()> task {};
+
+        {
+            std::unique_lock lock { _mutex };
+            if (!_condition.wait(lock, stopToken, [this]()
+                    { return !_tasks.empty(); }))
+            {
+                return;
+            }
+
+            task = std::move(_tasks.front());
+            _tasks.pop();
+        }
+
+        task();
+    }
+}
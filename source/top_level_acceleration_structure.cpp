@@ -5,10 +5,10 @@
 #include "vk_common.hpp"
 #include "vulkan_context.hpp"
 
-TopLevelAccelerationStructure::TopLevelAccelerationStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext)
+TopLevelAccelerationStructure::TopLevelAccelerationStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::vector<TLASInstance>& instances, const std::shared_ptr<BindlessResources>& resources, const std::shared_ptr<VulkanContext>& vulkanContext)
     : _vulkanContext(vulkanContext)
 {
-    InitializeStructure(blases, resources);
+    InitializeStructure(blases, instances, resources);
 }
 
 TopLevelAccelerationStructure::~TopLevelAccelerationStructure()
@@ -16,18 +16,109 @@ TopLevelAccelerationStructure::~TopLevelAccelerationStructure()
     _vulkanContext->Device().destroyAccelerationStructureKHR(_vkStructure, nullptr, _vulkanContext->Dldi());
 }
 
-void TopLevelAccelerationStructure::InitializeStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::shared_ptr<BindlessResources>& resources)
+void TopLevelAccelerationStructure::Update(vk::CommandBuffer commandBuffer, uint32_t resourcesFrame, const std::vector<TLASInstance>& instances)
 {
-    uint32_t geometryCount = 0;
-    std::vector<vk::AccelerationStructureInstanceKHR> accelerationStructureInstances {};
-    for (const auto& blas : blases)
+    for (size_t i = 0; i < _instances.size(); ++i)
     {
-        vk::TransformMatrixKHR transform = VkGLMToTransformMatrixKHR(blas.Transform());
+        _instances[i].transform = VkGLMToTransformMatrixKHR(instances.at(i).transform);
+    }
+    memcpy(_instanceBuffers.at(resourcesFrame)->mappedPtr, _instances.data(), _instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+    // The buffer is preferably placed in device memory, which doesn't have to be host coherent
+    VkCheckResult(vmaFlushAllocation(_vulkanContext->MemoryAllocator(), _instanceBuffers.at(resourcesFrame)->allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed flushing TLAS instance buffer!");
+
+    vk::BuildAccelerationStructureModeKHR mode = vk::BuildAccelerationStructureModeKHR::eUpdate;
+    if (RefitDegrades(instances))
+    {
+        mode = vk::BuildAccelerationStructureModeKHR::eBuild;
+        RecordBuildBounds(instances);
+    }
+
+    const vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = BuildGeometryInfo(mode, resourcesFrame);
+
+    vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
+    buildRangeInfo.primitiveCount = static_cast<uint32_t>(_instances.size());
+    const vk::AccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+
+    // Traversal of earlier frames has to be done before the structure changes under it, and the other way around
+    const ImageLayoutTransitionState traceState { vk::PipelineStageFlagBits2::eRayTracingShaderKHR, vk::AccessFlagBits2::eAccelerationStructureReadKHR };
+    const ImageLayoutTransitionState buildState { vk::PipelineStageFlagBits2::eAccelerationStructureBuildKHR,
+        vk::AccessFlagBits2::eAccelerationStructureReadKHR | vk::AccessFlagBits2::eAccelerationStructureWriteKHR };
+
+    VkGlobalMemoryBarrier(commandBuffer, traceState, buildState);
+    commandBuffer.buildAccelerationStructuresKHR(1, &buildGeometryInfo, &pBuildRangeInfo, _vulkanContext->Dldi());
+    VkGlobalMemoryBarrier(commandBuffer, buildState, traceState);
+}
+
+void TopLevelAccelerationStructure::RecordBuildBounds(const std::vector<TLASInstance>& instances)
+{
+    Bounds sceneBounds {};
+    for (size_t i = 0; i < _instanceLocalBounds.size(); ++i)
+    {
+        _instanceBuildBounds[i] = _instanceLocalBounds[i].Transformed(instances.at(i).transform);
+        sceneBounds.Grow(_instanceBuildBounds[i]);
+    }
+    _buildSceneExtent = sceneBounds.Diagonal();
+}
+
+bool TopLevelAccelerationStructure::RefitDegrades(const std::vector<TLASInstance>& instances) const
+{
+    const float maxDisplacement = MAX_DISPLACEMENT_BEFORE_REBUILD * _buildSceneExtent;
+
+    for (size_t i = 0; i < _instanceLocalBounds.size(); ++i)
+    {
+        const Bounds& buildBounds = _instanceBuildBounds[i];
+        if (buildBounds.Empty())
+        {
+            continue;
+        }
+
+        // Covers translation as well as rotation and scale, which move the corners without moving the center
+        const Bounds bounds = _instanceLocalBounds[i].Transformed(instances.at(i).transform);
+        if (glm::length(bounds.min - buildBounds.min) > maxDisplacement || glm::length(bounds.max - buildBounds.max) > maxDisplacement)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
 
-        vk::AccelerationStructureInstanceKHR& accelerationStructureInstance = accelerationStructureInstances.emplace_back();
+vk::AccelerationStructureBuildGeometryInfoKHR TopLevelAccelerationStructure::BuildGeometryInfo(vk::BuildAccelerationStructureModeKHR mode, uint32_t resourcesFrame)
+{
+    // The geometry is shared by every build, only the instances it reads from change per frame
+    _geometry.geometry.instances.data.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_instanceBuffers.at(resourcesFrame)->buffer);
+
+    vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo {};
+    buildGeometryInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
+    buildGeometryInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace | vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate;
+    buildGeometryInfo.mode = mode;
+    buildGeometryInfo.geometryCount = 1;
+    buildGeometryInfo.pGeometries = &_geometry;
+    buildGeometryInfo.dstAccelerationStructure = _vkStructure;
+    // Refits happen in place
+    if (mode == vk::BuildAccelerationStructureModeKHR::eUpdate)
+    {
+        buildGeometryInfo.srcAccelerationStructure = _vkStructure;
+    }
+    buildGeometryInfo.scratchData.deviceAddress = _scratchAddress;
+
+    return buildGeometryInfo;
+}
+
+void TopLevelAccelerationStructure::InitializeStructure(const std::vector<BottomLevelAccelerationStructure>& blases, const std::vector<TLASInstance>& instances, const std::shared_ptr<BindlessResources>& resources)
+{
+    _instances.reserve(instances.size());
+    _instanceLocalBounds.reserve(instances.size());
+    for (const auto& instance : instances)
+    {
+        const BottomLevelAccelerationStructure& blas = blases.at(instance.blasIndex);
+        _instanceLocalBounds.push_back(blas.LocalBounds());
+        vk::TransformMatrixKHR transform = VkGLMToTransformMatrixKHR(instance.transform);
+
+        vk::AccelerationStructureInstanceKHR& accelerationStructureInstance = _instances.emplace_back();
         accelerationStructureInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR; // vk::GeometryInstanceFlagBitsKHR::eTriangleFacingCullDisable
         accelerationStructureInstance.transform = transform;
-        accelerationStructureInstance.instanceCustomIndex = accelerationStructureInstances.size() - 1;
+        accelerationStructureInstance.instanceCustomIndex = _instances.size() - 1;
         accelerationStructureInstance.mask = 0xFF;
         accelerationStructureInstance.instanceShaderBindingTableRecordOffset = 0;
 
@@ -35,11 +126,10 @@ void TopLevelAccelerationStructure::InitializeStructure(const std::vector<Bottom
         blasDeviceAddress.accelerationStructure = blas.Structure();
         accelerationStructureInstance.accelerationStructureReference = _vulkanContext->Device().getAccelerationStructureAddressKHR(blasDeviceAddress, _vulkanContext->Dldi());
 
+        // Instances of the same structure point at the same geometry nodes
         BLASInstanceCreation blasInstanceCreation {};
-        blasInstanceCreation.firstGeometryIndex = geometryCount;
+        blasInstanceCreation.firstGeometryIndex = blas.FirstGeometryIndex();
         resources->BLASInstances().Create(blasInstanceCreation);
-
-        geometryCount++;
     }
 
     BufferCreation instancesBufferCreation {};
@@ -47,28 +137,26 @@ void TopLevelAccelerationStructure::InitializeStructure(const std::vector<Bottom
         .SetUsageFlags(vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR | vk::BufferUsageFlagBits::eShaderDeviceAddress)
         .SetMemoryUsage(VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE)
         .SetIsMappable(true)
-        .SetSize(accelerationStructureInstances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
-    _instancesBuffer = std::make_unique<Buffer>(instancesBufferCreation, _vulkanContext);
-    memcpy(_instancesBuffer->mappedPtr, accelerationStructureInstances.data(), accelerationStructureInstances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+        .SetSize(_instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
 
-    vk::DeviceOrHostAddressConstKHR instanceDataDeviceAddress {};
-    instanceDataDeviceAddress.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_instancesBuffer->buffer);
+    _instanceBuildBounds.resize(instances.size());
+    RecordBuildBounds(instances);
 
-    vk::AccelerationStructureGeometryKHR accelerationStructureGeometry {};
-    accelerationStructureGeometry.flags = vk::GeometryFlagBitsKHR::eOpaque;
-    accelerationStructureGeometry.geometryType = vk::GeometryTypeKHR::eInstances;
-    accelerationStructureGeometry.geometry.instances = vk::AccelerationStructureGeometryInstancesDataKHR {};
-    accelerationStructureGeometry.geometry.instances.arrayOfPointers = false;
-    accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
+    for (auto& instanceBuffer : _instanceBuffers)
+    {
+        instanceBuffer = std::make_unique<Buffer>(instancesBufferCreation, _vulkanContext);
+        memcpy(instanceBuffer->mappedPtr, _instances.data(), _instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+        VkCheckResult(vmaFlushAllocation(_vulkanContext->MemoryAllocator(), instanceBuffer->allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed flushing TLAS instance buffer!");
+    }
 
-    vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo {};
-    buildGeometryInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
-    buildGeometryInfo.flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
-    buildGeometryInfo.mode = vk::BuildAccelerationStructureModeKHR::eBuild;
-    buildGeometryInfo.geometryCount = 1;
-    buildGeometryInfo.pGeometries = &accelerationStructureGeometry;
+    _geometry.flags = vk::GeometryFlagBitsKHR::eOpaque;
+    _geometry.geometryType = vk::GeometryTypeKHR::eInstances;
+    _geometry.geometry.instances = vk::AccelerationStructureGeometryInstancesDataKHR {};
+    _geometry.geometry.instances.arrayOfPointers = false;
 
-    const uint32_t primitiveCount = accelerationStructureInstances.size();
+    vk::AccelerationStructureBuildGeometryInfoKHR buildGeometryInfo = BuildGeometryInfo(vk::BuildAccelerationStructureModeKHR::eBuild, 0);
+
+    const uint32_t primitiveCount = _instances.size();
     vk::AccelerationStructureBuildSizesInfoKHR buildSizesInfo = _vulkanContext->Device().getAccelerationStructureBuildSizesKHR(
         vk::AccelerationStructureBuildTypeKHR::eDevice, buildGeometryInfo, primitiveCount, _vulkanContext->Dldi());
 
@@ -87,17 +175,19 @@ void TopLevelAccelerationStructure::InitializeStructure(const std::vector<Bottom
     createInfo.type = vk::AccelerationStructureTypeKHR::eTopLevel;
     _vkStructure = _vulkanContext->Device().createAccelerationStructureKHR(createInfo, nullptr, _vulkanContext->Dldi());
 
+    // Kept around for refits, which use the same scratch memory as rebuilds
+    const vk::DeviceSize scratchAlignment = _vulkanContext->AccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
     BufferCreation scratchBufferCreation {};
     scratchBufferCreation.SetName("TLAS Scratch Buffer")
         .SetUsageFlags(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress)
         .SetMemoryUsage(VMA_MEMORY_USAGE_GPU_ONLY)
         .SetIsMappable(false)
-        .SetSize(buildSizesInfo.buildScratchSize);
+        .SetSize(std::max(buildSizesInfo.buildScratchSize, buildSizesInfo.updateScratchSize) + scratchAlignment);
     _scratchBuffer = std::make_unique<Buffer>(scratchBufferCreation, _vulkanContext);
+    _scratchAddress = VkAlignUp(_vulkanContext->GetBufferDeviceAddress(_scratchBuffer->buffer), scratchAlignment);
 
     // Fill remaining data
-    buildGeometryInfo.dstAccelerationStructure = _vkStructure;
-    buildGeometryInfo.scratchData.deviceAddress = _vulkanContext->GetBufferDeviceAddress(_scratchBuffer->buffer);
+    buildGeometryInfo = BuildGeometryInfo(vk::BuildAccelerationStructureModeKHR::eBuild, 0);
 
     vk::AccelerationStructureBuildRangeInfoKHR buildRangeInfo {};
     buildRangeInfo.primitiveCount = primitiveCount;
@@ -106,7 +196,7 @@ void TopLevelAccelerationStructure::InitializeStructure(const std::vector<Bottom
     buildRangeInfo.transformOffset = 0;
     std::vector<vk::AccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos = { &buildRangeInfo };
 
-    SingleTimeCommands singleTimeCommands { _vulkanContext };
+    SingleTimeCommands singleTimeCommands { _vulkanContext, QueueType::eCompute };
     singleTimeCommands.Record([&](vk::CommandBuffer commandBuffer)
         { commandBuffer.buildAccelerationStructuresKHR(1, &buildGeometryInfo, pBuildRangeInfos.data(), _vulkanContext->Dldi()); });
     singleTimeCommands.SubmitAndWait();
@@ -0,0 +1,243 @@
+#include "upload_manager.hpp"
+#include "resources/gpu_resources.hpp"
+#include "vk_common.hpp"
+#include "vulkan_context.hpp"
+#include <cstring>
+#include <limits>
+
+UploadManager::UploadManager(const std::shared_ptr<VulkanContext>& vulkanContext)
+    : _vulkanContext(vulkanContext)
+{
+    BufferCreation stagingRingCreation {};
+    stagingRingCreation.SetName("Staging Ring")
+        .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
+        .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
+        .SetIsMappable(true)
+        .SetSize(STAGING_RING_SIZE);
+    _stagingRing = std::make_unique<Buffer>(stagingRingCreation, _vulkanContext);
+    _stagingData = static_cast<std::byte*>(_stagingRing->mappedPtr);
+}
+
+UploadManager::~UploadManager()
+{
+    FlushAndWait();
+}
+
+void UploadManager::UploadBuffer(vk::Buffer buffer, std::span<const std::byte> data, vk::DeviceSize bufferOffset)
+{
+    if (data.empty())
+    {
+        return;
+    }
+
+    std::scoped_lock lock { _mutex };
+    const auto [stagingBuffer, stagingOffset] = Stage(data);
+
+    vk::BufferCopy region {};
+    region.srcOffset = stagingOffset;
+    region.dstOffset = bufferOffset;
+    region.size = data.size();
+    RecordingCommandBuffer().copyBuffer(stagingBuffer, buffer, 1, &region);
+}
+
+void UploadManager::UploadImage(vk::Image image, vk::Format format, uint32_t width, uint32_t height, uint32_t mipLevels, std::span<const std::byte> data)
+{
+    std::scoped_lock lock { _mutex };
+    const auto [stagingBuffer, stagingOffset] = Stage(data);
+
+    // Shader stages don't exist on the transfer queue, the timeline wait of the graphics queue orders the reads instead
+    const ImageLayoutTransitionState transferState { vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite };
+    const ImageLayoutTransitionState handoffState { vk::PipelineStageFlagBits2::eNone, vk::AccessFlags2 { 0 } };
+
+    const vk::CommandBuffer commandBuffer = RecordingCommandBuffer();
+    VkTransitionImageLayout(commandBuffer, image, format, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1, 0, mipLevels);
+
+    vk::DeviceSize levelOffset = stagingOffset;
+    for (uint32_t i = 0; i < mipLevels; ++i)
+    {
+        VkCopyBufferToImage(commandBuffer, stagingBuffer, image, width, height, levelOffset, i);
+        levelOffset += VkMipLevelSize(format, width, height, i);
+    }
+
+    VkImageBarrier(commandBuffer, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, transferState, handoffState, mipLevels);
+}
+
+uint64_t UploadManager::Flush()
+{
+    std::scoped_lock lock { _mutex };
+    return FlushLocked();
+}
+
+void UploadManager::FlushAndWait()
+{
+    std::scoped_lock lock { _mutex };
+    FlushLocked();
+    while (!_inFlight.empty())
+    {
+        RetireCompleted(true);
+    }
+}
+
+std::pair<vk::Buffer, vk::DeviceSize> UploadManager::Stage(std::span<const std::byte> data)
+{
+    if (data.size() > STAGING_RING_SIZE)
+    {
+        BufferCreation stagingBufferCreation {};
+        stagingBufferCreation.SetName("Dedicated Staging Buffer")
+            .SetUsageFlags(vk::BufferUsageFlagBits::eTransferSrc)
+            .SetMemoryUsage(VMA_MEMORY_USAGE_CPU_ONLY)
+            .SetIsMappable(true)
+            .SetSize(data.size());
+        const auto& stagingBuffer = _recording.dedicatedBuffers.emplace_back(std::make_unique<Buffer>(stagingBufferCreation, _vulkanContext));
+        std::memcpy(stagingBuffer->mappedPtr, data.data(), data.size());
+        VkCheckResult(vmaFlushAllocation(_vulkanContext->MemoryAllocator(), stagingBuffer->allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed flushing dedicated staging buffer!");
+        return { stagingBuffer->buffer, 0 };
+    }
+
+    RetireCompleted(false);
+
+    // Submits what is recorded so far and waits for the oldest copies, until there is room in the ring
+    vk::DeviceSize offset {};
+    while (!TryAllocate(data.size(), offset))
+    {
+        if (_recording.ringBytes > 0)
+        {
+            FlushLocked();
+        }
+        RetireCompleted(true);
+    }
+
+    std::memcpy(_stagingData + offset, data.data(), data.size());
+    return { _stagingRing->buffer, offset };
+}
+
+bool UploadManager::TryAllocate(vk::DeviceSize size, vk::DeviceSize& offset)
+{
+    if (_used == 0)
+    {
+        _head = 0;
+        _tail = 0;
+    }
+
+    const vk::DeviceSize alignedHead = VkAlignUp(_head, STAGING_ALIGNMENT);
+    vk::DeviceSize skipped {};
+
+    if (_head > _tail || _used == 0)
+    {
+        // Free space is at the end of the ring, and at the start up to the tail
+        if (alignedHead + size <= STAGING_RING_SIZE)
+        {
+            offset = alignedHead;
+            skipped = alignedHead - _head;
+        }
+        else if (size <= _tail)
+        {
+            offset = 0;
+            skipped = STAGING_RING_SIZE - _head;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if (_head < _tail && alignedHead + size <= _tail)
+    {
+        offset = alignedHead;
+        skipped = alignedHead - _head;
+    }
+    else
+    {
+        return false;
+    }
+
+    _head = offset + size;
+    _used += skipped + size;
+    _recording.ringBytes += skipped + size;
+    _recording.ringEnd = _head;
+    return true;
+}
+
+vk::CommandBuffer UploadManager::RecordingCommandBuffer()
+{
+    if (_recording.commandBuffer)
+    {
+        return _recording.commandBuffer;
+    }
+
+    vk::CommandBufferAllocateInfo allocateInfo {};
+    allocateInfo.level = vk::CommandBufferLevel::ePrimary;
+    allocateInfo.commandPool = _vulkanContext->CommandPool(QueueType::eTransfer);
+    allocateInfo.commandBufferCount = 1;
+    VkCheckResult(_vulkanContext->Device().allocateCommandBuffers(&allocateInfo, &_recording.commandBuffer), "[VULKAN] Failed allocating upload command buffer!");
+
+    vk::CommandBufferBeginInfo beginInfo {};
+    beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+    VkCheckResult(_recording.commandBuffer.begin(&beginInfo), "[VULKAN] Failed beginning upload command buffer!");
+
+    return _recording.commandBuffer;
+}
+
+uint64_t UploadManager::FlushLocked()
+{
+    // Every staged upload records a copy, so without a command buffer there is nothing to submit
+    if (!_recording.commandBuffer)
+    {
+        return _vulkanContext->TimelineValue(QueueType::eTransfer);
+    }
+
+    _recording.commandBuffer.end();
+
+    // The ring is written sequentially by the CPU, flushing all of it covers memory that isn't host coherent
+    VkCheckResult(vmaFlushAllocation(_vulkanContext->MemoryAllocator(), _stagingRing->allocation, 0, VK_WHOLE_SIZE), "[VULKAN] Failed flushing staging ring!");
+
+    _recording.timelineValue = _vulkanContext->NextTimelineValue(QueueType::eTransfer);
+
+    vk::SemaphoreSubmitInfo signal {};
+    signal.semaphore = _vulkanContext->Timeline(QueueType::eTransfer);
+    signal.value = _recording.timelineValue;
+    signal.stageMask = vk::PipelineStageFlagBits2::eAllCommands;
+
+    vk::CommandBufferSubmitInfo commandBufferInfo {};
+    commandBufferInfo.commandBuffer = _recording.commandBuffer;
+
+    vk::SubmitInfo2 submitInfo {};
+    submitInfo.commandBufferInfoCount = 1;
+    submitInfo.pCommandBufferInfos = &commandBufferInfo;
+    submitInfo.signalSemaphoreInfoCount = 1;
+    submitInfo.pSignalSemaphoreInfos = &signal;
+    VkCheckResult(_vulkanContext->Queue(QueueType::eTransfer).submit2(1, &submitInfo, nullptr), "[VULKAN] Failed submitting uploads to the transfer queue!");
+
+    const uint64_t timelineValue = _recording.timelineValue;
+    _inFlight.push_back(std::move(_recording));
+    _recording = Batch {};
+    return timelineValue;
+}
+
+void UploadManager::RetireCompleted(bool waitForOldest)
+{
+    const vk::Semaphore timeline = _vulkanContext->Timeline(QueueType::eTransfer);
+
+    if (waitForOldest && !_inFlight.empty())
+    {
+        const uint64_t timelineValue = _inFlight.front().timelineValue;
+
+        vk::SemaphoreWaitInfo waitInfo {};
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &timelineValue;
+        VkCheckResult(_vulkanContext->Device().waitSemaphores(&waitInfo, std::numeric_limits<uint64_t>::max()), "[VULKAN] Failed waiting for uploads!");
+    }
+
+    const uint64_t completedValue = _vulkanContext->Device().getSemaphoreCounterValue(timeline);
+    while (!_inFlight.empty() && _inFlight.front().timelineValue <= completedValue)
+    {
+        Batch& batch = _inFlight.front();
+        _vulkanContext->Device().free(_vulkanContext->CommandPool(QueueType::eTransfer), batch.commandBuffer);
+        if (batch.ringBytes > 0)
+        {
+            _tail = batch.ringEnd;
+            _used -= batch.ringBytes;
+        }
+        _inFlight.pop_front();
+    }
+}
@@ -1,5 +1,6 @@
 #include "vk_common.hpp"
 #include <spdlog/spdlog.h>
+#include <bit>
 #include <unordered_map>
 
 void VkCheckResult(vk::Result result, std::string_view message)
@@ -142,6 +143,46 @@ void VkTransitionImageLayout(vk::CommandBuffer commandBuffer, vk::Image image, v
     commandBuffer.pipelineBarrier2(dependencyInfo);
 }
 
+void VkGlobalMemoryBarrier(vk::CommandBuffer commandBuffer, const ImageLayoutTransitionState& sourceState, const ImageLayoutTransitionState& destinationState)
+{
+    vk::MemoryBarrier2 barrier {};
+    barrier.srcStageMask = sourceState.pipelineStage;
+    barrier.srcAccessMask = sourceState.accessFlags;
+    barrier.dstStageMask = destinationState.pipelineStage;
+    barrier.dstAccessMask = destinationState.accessFlags;
+
+    vk::DependencyInfo dependencyInfo {};
+    dependencyInfo.setMemoryBarrierCount(1)
+        .setPMemoryBarriers(&barrier);
+
+    commandBuffer.pipelineBarrier2(dependencyInfo);
+}
+
+void VkImageBarrier(vk::CommandBuffer commandBuffer, vk::Image image, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, const ImageLayoutTransitionState& sourceState, const ImageLayoutTransitionState& destinationState, uint32_t mipCount)
+{
+    vk::ImageMemoryBarrier2 barrier {};
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = vk::QueueFamilyIgnored;
+    barrier.dstQueueFamilyIndex = vk::QueueFamilyIgnored;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mipCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcStageMask = sourceState.pipelineStage;
+    barrier.srcAccessMask = sourceState.accessFlags;
+    barrier.dstStageMask = destinationState.pipelineStage;
+    barrier.dstAccessMask = destinationState.accessFlags;
+
+    vk::DependencyInfo dependencyInfo {};
+    dependencyInfo.setImageMemoryBarrierCount(1)
+        .setPImageMemoryBarriers(&barrier);
+
+    commandBuffer.pipelineBarrier2(dependencyInfo);
+}
+
 void VkCopyImageToImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk::Image dstImage, vk::Extent2D srcSize, vk::Extent2D dstSize)
 {
     vk::ImageBlit2 region {};
@@ -177,10 +218,27 @@ void VkCopyImageToImage(vk::CommandBuffer commandBuffer, vk::Image srcImage, vk:
     commandBuffer.blitImage2(&blitInfo);
 }
 
-void VkCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
+void VkCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height, vk::DeviceSize bufferOffset, uint32_t mipLevel)
 {
     vk::BufferImageCopy region {};
+    region.bufferOffset = bufferOffset;
+    region.bufferImageHeight = 0;
+    region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+    region.imageSubresource.mipLevel = mipLevel;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = vk::Offset3D { 0, 0, 0 };
+    region.imageExtent = vk::Extent3D { std::max(width >> mipLevel, 1u), std::max(height >> mipLevel, 1u), 1 };
+
+    commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+}
+
+void VkCopyImageToBuffer(vk::CommandBuffer commandBuffer, vk::Image image, vk::Buffer buffer, uint32_t width, uint32_t height)
+{
+    vk::BufferImageCopy region {};
+    region.bufferOffset = 0;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
@@ -190,7 +248,7 @@ void VkCopyBufferToImage(vk::CommandBuffer commandBuffer, vk::Buffer buffer, vk:
     region.imageOffset = vk::Offset3D { 0, 0, 0 };
     region.imageExtent = vk::Extent3D { width, height, 1 };
 
-    commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+    commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer, 1, &region);
 }
 
 void VkCopyBufferToBuffer(vk::CommandBuffer commandBuffer, vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size, uint32_t offset)
@@ -210,3 +268,59 @@ VkTransformMatrixKHR VkGLMToTransformMatrixKHR(const glm::mat4& matrix)
     memcpy(&out, &temp, sizeof(VkTransformMatrixKHR));
     return out;
 }
+
+vk::DeviceSize VkAlignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t VkMipLevelCount(uint32_t width, uint32_t height)
+{
+    return std::bit_width(std::max(std::max(width, height), 1u));
+}
+
+vk::DeviceSize VkMipLevelSize(vk::Format format, uint32_t width, uint32_t height, uint32_t mipLevel)
+{
+    const vk::DeviceSize levelWidth = std::max(width >> mipLevel, 1u);
+    const vk::DeviceSize levelHeight = std::max(height >> mipLevel, 1u);
+    // Block compressed levels are padded to whole 4x4 blocks
+    const vk::DeviceSize blockCount = ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4);
+
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+        return levelWidth * levelHeight * 4;
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+        return blockCount * 8;
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return blockCount * 16;
+    default:
+        spdlog::error("[VULKAN] Unsupported format for mip level size: {}", vk::to_string(format));
+        return 0;
+    }
+}
+
+bool VkIsBlockCompressed(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eBc1RgbaUnormBlock:
+    case vk::Format::eBc1RgbaSrgbBlock:
+    case vk::Format::eBc3UnormBlock:
+    case vk::Format::eBc3SrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -54,9 +54,9 @@ VKAPI_ATTR VkBool32 VKAPI_CALL ValidationLayerCallback(
     return VK_FALSE;
 }
 
-bool QueueFamilyIndices::IsComplete() const
+bool QueueFamilyIndices::IsComplete(bool requiresPresent) const
 {
-    return graphicsFamily.has_value() && presentFamily.has_value();
+    return graphicsFamily.has_value() && (presentFamily.has_value() || !requiresPresent);
 }
 
 QueueFamilyIndices QueueFamilyIndices::FindQueueFamilies(vk::PhysicalDevice device, vk::SurfaceKHR surface)
@@ -71,12 +71,25 @@ QueueFamilyIndices QueueFamilyIndices::FindQueueFamilies(vk::PhysicalDevice devi
 
     for (size_t i = 0; i < queueFamilies.size(); ++i)
     {
-        if (queueFamilies[i].queueFlags & vk::QueueFlagBits::eGraphics)
+        const vk::QueueFlags flags = queueFamilies[i].queueFlags;
+
+        if ((flags & vk::QueueFlagBits::eGraphics) && !indices.graphicsFamily.has_value())
         {
             indices.graphicsFamily = i;
         }
 
-        if (!indices.presentFamily.has_value())
+        if ((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics) && !indices.computeFamily.has_value())
+        {
+            indices.computeFamily = i;
+        }
+
+        // Only the copy engines, on GPUs that have them
+        if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) && !indices.transferFamily.has_value())
+        {
+            indices.transferFamily = i;
+        }
+
+        if (surface && !indices.presentFamily.has_value())
         {
             vk::Bool32 supported;
             VkCheckResult(device.getSurfaceSupportKHR(i, surface, &supported),
@@ -86,11 +99,15 @@ QueueFamilyIndices QueueFamilyIndices::FindQueueFamilies(vk::PhysicalDevice devi
                 indices.presentFamily = i;
             }
         }
+    }
 
-        if (indices.IsComplete())
-        {
-            break;
-        }
+    if (!indices.computeFamily.has_value())
+    {
+        indices.computeFamily = indices.graphicsFamily;
+    }
+    if (!indices.transferFamily.has_value())
+    {
+        indices.transferFamily = indices.computeFamily;
     }
 
     return indices;
@@ -104,23 +121,38 @@ VulkanContext::VulkanContext(const VulkanInitInfo& initInfo)
     InitializeInstance(initInfo);
     _dldi = vk::detail::DispatchLoaderDynamic { _instance, vkGetInstanceProcAddr, _device, vkGetDeviceProcAddr };
     InizializeValidationLayers();
-    _surface = initInfo.retrieveSurface(_instance);
+
+    if (initInfo.retrieveSurface)
+    {
+        _surface = initInfo.retrieveSurface(_instance);
+    }
+    spdlog::info("[VULKAN] Running headless: {}", IsHeadless());
 
     InitializePhysicalDevice();
     InitializeDevice();
-    InitializeCommandPool();
+    InitializeCommandPools();
+    InitializeTimelines();
     InitializeVMA();
 }
 
 VulkanContext::~VulkanContext()
 {
+    for (size_t i = 0; i < _commandPools.size(); ++i)
+    {
+        _device.destroy(_commandPools[i]);
+        _device.destroy(_timelines[i]);
+    }
+
     if (_validationLayersEnabled)
     {
         _instance.destroyDebugUtilsMessengerEXT(_debugMessenger, nullptr, _dldi);
     }
 
     vmaDestroyAllocator(_vmaAllocator);
-    _instance.destroy(_surface);
+    if (_surface)
+    {
+        _instance.destroy(_surface);
+    }
     _device.destroy();
     _instance.destroy();
 }
@@ -134,6 +166,15 @@ vk::PhysicalDeviceRayTracingPipelinePropertiesKHR VulkanContext::RayTracingPipel
     return rayTracingPipelineProperties;
 }
 
+vk::PhysicalDeviceAccelerationStructurePropertiesKHR VulkanContext::AccelerationStructureProperties() const
+{
+    vk::PhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties {};
+    vk::PhysicalDeviceProperties2KHR physicalDeviceProperties {};
+    physicalDeviceProperties.pNext = &accelerationStructureProperties;
+    _physicalDevice.getProperties2(&physicalDeviceProperties);
+    return accelerationStructureProperties;
+}
+
 uint64_t VulkanContext::GetBufferDeviceAddress(vk::Buffer buffer) const
 {
     vk::BufferDeviceAddressInfoKHR bufferDeviceAI {};
@@ -219,7 +260,12 @@ void VulkanContext::InitializeDevice()
 {
     _queueFamilyIndices = QueueFamilyIndices::FindQueueFamilies(_physicalDevice, _surface);
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos {};
-    std::set<uint32_t> uniqueQueueFamilies = { _queueFamilyIndices.graphicsFamily.value(), _queueFamilyIndices.presentFamily.value() };
+    std::set<uint32_t> uniqueQueueFamilies = { _queueFamilyIndices.graphicsFamily.value(), _queueFamilyIndices.computeFamily.value(), _queueFamilyIndices.transferFamily.value() };
+    _sharedQueueFamilies.assign(uniqueQueueFamilies.begin(), uniqueQueueFamilies.end());
+    if (_queueFamilyIndices.presentFamily.has_value())
+    {
+        uniqueQueueFamilies.insert(_queueFamilyIndices.presentFamily.value());
+    }
     float queuePriority = 1.0f;
 
     for (uint32_t familyQueueIndex : uniqueQueueFamilies)
@@ -232,14 +278,11 @@ void VulkanContext::InitializeDevice()
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
-    vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceSynchronization2Features, vk::PhysicalDeviceDescriptorIndexingFeatures,
+    vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceSynchronization2Features, vk::PhysicalDeviceTimelineSemaphoreFeatures, vk::PhysicalDeviceDescriptorIndexingFeatures,
         vk::PhysicalDeviceScalarBlockLayoutFeatures, vk::PhysicalDeviceBufferDeviceAddressFeatures, vk::PhysicalDeviceAccelerationStructureFeaturesKHR,
-        vk::PhysicalDeviceRayTracingPipelineFeaturesKHR, vk::PhysicalDeviceShaderClockFeaturesKHR>
+        vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>
         structureChain;
 
-    auto& shaderClockFeatures = structureChain.get<vk::PhysicalDeviceShaderClockFeaturesKHR>();
-    shaderClockFeatures.shaderSubgroupClock = true;
-
     auto& rayTracingPipelineFeatures = structureChain.get<vk::PhysicalDeviceRayTracingPipelineFeaturesKHR>();
     rayTracingPipelineFeatures.rayTracingPipeline = true;
 
@@ -258,15 +301,25 @@ void VulkanContext::InitializeDevice()
     auto& synchronization2Features = structureChain.get<vk::PhysicalDeviceSynchronization2Features>();
     synchronization2Features.synchronization2 = true;
 
+    // Hands work of the compute and transfer queues over to the graphics queue
+    auto& timelineSemaphoreFeatures = structureChain.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+    timelineSemaphoreFeatures.timelineSemaphore = true;
+
     auto& deviceFeatures = structureChain.get<vk::PhysicalDeviceFeatures2>();
     _physicalDevice.getFeatures2(&deviceFeatures);
 
+    // Overwritten with the supported features above, so host commands stay enabled when the device has them (e.g. lavapipe)
+    _hostAccelerationStructureCommands = accelerationStructuresFeatures.accelerationStructureHostCommands;
+    _textureCompressionBC = deviceFeatures.features.textureCompressionBC;
+    _traceRaysIndirect = rayTracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect;
+
     auto& createInfo = structureChain.get<vk::DeviceCreateInfo>();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = nullptr;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(_deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = _deviceExtensions.data();
+    const std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
     if (_validationLayersEnabled)
     {
@@ -281,17 +334,56 @@ void VulkanContext::InitializeDevice()
 
     VkCheckResult(_physicalDevice.createDevice(&createInfo, nullptr, &_device), "[VULKAN] Failed creating a logical device!");
 
-    _device.getQueue(_queueFamilyIndices.graphicsFamily.value(), 0, &_graphicsQueue);
-    _device.getQueue(_queueFamilyIndices.presentFamily.value(), 0, &_presentQueue);
+    for (size_t i = 0; i < _queues.size(); ++i)
+    {
+        _device.getQueue(QueueFamily(static_cast<QueueType>(i)), 0, &_queues[i]);
+    }
+    spdlog::info("[VULKAN] Queue families, graphics: {}, compute: {}, transfer: {}", _queueFamilyIndices.graphicsFamily.value(),
+        _queueFamilyIndices.computeFamily.value(), _queueFamilyIndices.transferFamily.value());
+
+    if (_queueFamilyIndices.presentFamily.has_value())
+    {
+        _device.getQueue(_queueFamilyIndices.presentFamily.value(), 0, &_presentQueue);
+    }
 }
 
-void VulkanContext::InitializeCommandPool()
+void VulkanContext::InitializeCommandPools()
 {
-    vk::CommandPoolCreateInfo commandPoolCreateInfo {};
-    commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
-    commandPoolCreateInfo.queueFamilyIndex = _queueFamilyIndices.graphicsFamily.value();
+    for (size_t i = 0; i < _commandPools.size(); ++i)
+    {
+        vk::CommandPoolCreateInfo commandPoolCreateInfo {};
+        commandPoolCreateInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+        commandPoolCreateInfo.queueFamilyIndex = QueueFamily(static_cast<QueueType>(i));
+
+        VkCheckResult(_device.createCommandPool(&commandPoolCreateInfo, nullptr, &_commandPools[i]), "[VULKAN] Failed creating command pool!");
+    }
+}
+
+void VulkanContext::InitializeTimelines()
+{
+    for (auto& timeline : _timelines)
+    {
+        vk::SemaphoreTypeCreateInfo typeCreateInfo {};
+        typeCreateInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+        typeCreateInfo.initialValue = 0;
+
+        vk::SemaphoreCreateInfo createInfo {};
+        createInfo.pNext = &typeCreateInfo;
+        VkCheckResult(_device.createSemaphore(&createInfo, nullptr, &timeline), "[VULKAN] Failed creating timeline semaphore!");
+    }
+}
 
-    VkCheckResult(_device.createCommandPool(&commandPoolCreateInfo, nullptr, &_commandPool), "[VULKAN] Failed creating command pool!");
+uint32_t VulkanContext::QueueFamily(QueueType type) const
+{
+    switch (type)
+    {
+    case QueueType::eCompute:
+        return _queueFamilyIndices.computeFamily.value();
+    case QueueType::eTransfer:
+        return _queueFamilyIndices.transferFamily.value();
+    default:
+        return _queueFamilyIndices.graphicsFamily.value();
+    }
 }
 
 void VulkanContext::InitializeVMA()
@@ -335,6 +427,17 @@ std::vector<const char*> VulkanContext::GetRequiredInstanceExtensions(const Vulk
     return extensions;
 }
 
+std::vector<const char*> VulkanContext::GetRequiredDeviceExtensions() const
+{
+    std::vector<const char*> extensions = _deviceExtensions;
+    if (!IsHeadless())
+    {
+        extensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+
+    return extensions;
+}
+
 uint32_t VulkanContext::RateDeviceSuitability(const vk::PhysicalDevice& deviceToRate) const
 {
     vk::PhysicalDeviceFeatures2 deviceFeatures;
@@ -346,7 +449,7 @@ uint32_t VulkanContext::RateDeviceSuitability(const vk::PhysicalDevice& deviceTo
     QueueFamilyIndices familyIndices = QueueFamilyIndices::FindQueueFamilies(deviceToRate, _surface);
 
     // Failed if graphics family queue is not supported
-    if (!familyIndices.IsComplete())
+    if (!familyIndices.IsComplete(!IsHeadless()))
     {
         return 0;
     }
@@ -357,12 +460,15 @@ uint32_t VulkanContext::RateDeviceSuitability(const vk::PhysicalDevice& deviceTo
         return 0;
     }
 
-    // Check support for swap chain
-    SwapChain::SupportDetails swapChainSupportDetails = SwapChain::QuerySupport(deviceToRate, _surface);
-    bool swapChainUnsupported = swapChainSupportDetails.formats.empty() || swapChainSupportDetails.presentModes.empty();
-    if (swapChainUnsupported)
+    // Check support for swap chain, when presenting to a surface
+    if (!IsHeadless())
     {
-        return 0;
+        SwapChain::SupportDetails swapChainSupportDetails = SwapChain::QuerySupport(deviceToRate, _surface);
+        bool swapChainUnsupported = swapChainSupportDetails.formats.empty() || swapChainSupportDetails.presentModes.empty();
+        if (swapChainUnsupported)
+        {
+            return 0;
+        }
     }
 
     uint32_t score = 0;
@@ -387,7 +493,8 @@ uint32_t VulkanContext::RateDeviceSuitability(const vk::PhysicalDevice& deviceTo
 bool VulkanContext::AreExtensionsSupported(const vk::PhysicalDevice& deviceToCheckSupport) const
 {
     std::vector<vk::ExtensionProperties> availableExtensions = deviceToCheckSupport.enumerateDeviceExtensionProperties();
-    std::set<std::string> requiredExtensions { _deviceExtensions.begin(), _deviceExtensions.end() };
+    const std::vector<const char*> deviceExtensions = GetRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions { deviceExtensions.begin(), deviceExtensions.end() };
     for (const auto& extension : availableExtensions)
     {
         requiredExtensions.erase(extension.extensionName);